@@ -1,6 +1,7 @@
 ﻿#include <iostream>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include <boost/json.hpp>
 #include "bserv/common.hpp"
@@ -22,8 +23,20 @@ void show_config(const bserv::server_config& config) {
 		<< "\nthreads: " << config.get_num_threads()
 		<< "\nrotation: " << config.get_log_rotation_size() / 1024 / 1024
 		<< "\nlog path: " << config.get_log_path()
-		<< "\ndb-conn: " << config.get_num_db_conn()
-		<< "\nconn-str: " << config.get_db_conn_str() << std::endl;
+		<< "\ndb-conn: " << config.get_min_db_conn() << "-" << config.get_num_db_conn()
+		<< "\nconn-str: " << config.get_db_conn_str()
+		<< "\nreplicas: " << config.get_db_replica_conn_strs().size()
+		<< "\ndb-cache-size: " << config.get_db_cache_size()
+		<< "\ncompression-level: " << config.get_compression_level()
+		<< "\ncompression-threshold: " << config.get_compression_threshold()
+		<< "\nws-ping-interval: " << config.get_websocket_ping_interval()
+		<< "\nws-idle-timeout: " << config.get_websocket_idle_timeout()
+		<< "\nws-max-sessions: " << config.get_max_websocket_sessions()
+		<< "\nws-max-sessions-per-ip: " << config.get_max_websocket_sessions_per_ip()
+		<< "\nmax-connections: " << config.get_max_connections()
+		<< "\nrequests: " << config.get_min_requests() << "-" << config.get_max_requests()
+		<< "\nadmission-target-latency: " << config.get_admission_target_latency()
+		<< "\nshutdown-timeout: " << config.get_shutdown_timeout() << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -44,8 +57,40 @@ int main(int argc, char* argv[]) {
 				config.set_num_threads((int)config_obj["thread-num"].as_int64());
 			if (config_obj.contains("conn-num"))
 				config.set_num_db_conn((int)config_obj["conn-num"].as_int64());
+			if (config_obj.contains("conn-min"))
+				config.set_min_db_conn((int)config_obj["conn-min"].as_int64());
 			if (config_obj.contains("conn-str"))
 				config.set_db_conn_str(config_obj["conn-str"].as_string().c_str());
+			if (config_obj.contains("replica-conn-strs")) {
+				std::vector<std::string> replica_conn_strs;
+				for (auto& conn_str : config_obj["replica-conn-strs"].as_array())
+					replica_conn_strs.emplace_back(conn_str.as_string().c_str());
+				config.set_db_replica_conn_strs(std::move(replica_conn_strs));
+			}
+			if (config_obj.contains("db-cache-size"))
+				config.set_db_cache_size((std::size_t)config_obj["db-cache-size"].as_int64());
+			if (config_obj.contains("compression-level"))
+				config.set_compression_level((int)config_obj["compression-level"].as_int64());
+			if (config_obj.contains("compression-threshold"))
+				config.set_compression_threshold((std::size_t)config_obj["compression-threshold"].as_int64());
+			if (config_obj.contains("ws-ping-interval"))
+				config.set_websocket_ping_interval((int)config_obj["ws-ping-interval"].as_int64());
+			if (config_obj.contains("ws-idle-timeout"))
+				config.set_websocket_idle_timeout((int)config_obj["ws-idle-timeout"].as_int64());
+			if (config_obj.contains("ws-max-sessions"))
+				config.set_max_websocket_sessions((std::size_t)config_obj["ws-max-sessions"].as_int64());
+			if (config_obj.contains("ws-max-sessions-per-ip"))
+				config.set_max_websocket_sessions_per_ip((std::size_t)config_obj["ws-max-sessions-per-ip"].as_int64());
+			if (config_obj.contains("max-connections"))
+				config.set_max_connections((std::size_t)config_obj["max-connections"].as_int64());
+			if (config_obj.contains("min-requests"))
+				config.set_min_requests((std::size_t)config_obj["min-requests"].as_int64());
+			if (config_obj.contains("max-requests"))
+				config.set_max_requests((std::size_t)config_obj["max-requests"].as_int64());
+			if (config_obj.contains("admission-target-latency"))
+				config.set_admission_target_latency((int)config_obj["admission-target-latency"].as_int64());
+			if (config_obj.contains("shutdown-timeout"))
+				config.set_shutdown_timeout((int)config_obj["shutdown-timeout"].as_int64());
 			if (config_obj.contains("log-dir"))
 				config.set_log_path(std::string{ config_obj["log-dir"].as_string() });
 			if (!config_obj.contains("template_root")) {
@@ -73,17 +118,20 @@ int main(int argc, char* argv[]) {
 			bserv::placeholders::session),
 		bserv::make_path("/register", &user_register,
 			bserv::placeholders::request,
-			bserv::placeholders::json_params,
+			bserv::placeholders::params_as<register_request>,
 			bserv::placeholders::db_connection_ptr),
+		// the passwords are checked with PBKDF2, which is expensive,
+		// so each client may only try a few of them per second
 		bserv::make_path("/login", &user_login,
 			bserv::placeholders::request,
 			bserv::placeholders::json_params,
 			bserv::placeholders::db_connection_ptr,
-			bserv::placeholders::session),
+			bserv::placeholders::session)
+			->rate_limit(20, 200),
 		bserv::make_path("/logout", &user_logout,
 			bserv::placeholders::session),
 		bserv::make_path("/find/<str>", &find_user,
-			bserv::placeholders::db_connection_ptr,
+			bserv::placeholders::db_read_connection_ptr,
 			bserv::placeholders::_1),
 		bserv::make_path("/send", &send_request,
 			bserv::placeholders::session,
@@ -91,10 +139,18 @@ int main(int argc, char* argv[]) {
 			bserv::placeholders::json_params),
 		bserv::make_path("/echo", &echo,
 			bserv::placeholders::json_params),
+		bserv::make_path("/upload", &upload,
+			bserv::placeholders::request_body)
+			->streaming()->body_limit(64 * 1024 * 1024),
+		// the file parts of the form are spooled to disk
+		bserv::make_path("/upload_form", &echo,
+			bserv::placeholders::json_params)
+			->streaming()->body_limit(64 * 1024 * 1024),
 
 		// serving static files
 		bserv::make_path("/statics/<path>", &serve_static_files,
-			bserv::placeholders::response,
+			bserv::placeholders::request,
+			bserv::placeholders::response_writer,
 			bserv::placeholders::_1),
 
 		// serving html template files
@@ -106,24 +162,22 @@ int main(int argc, char* argv[]) {
 			bserv::placeholders::response,
 			bserv::placeholders::json_params,
 			bserv::placeholders::db_connection_ptr,
-			bserv::placeholders::session),
+			bserv::placeholders::session)
+			->rate_limit(20, 200),
 		bserv::make_path("/form_logout", &form_logout,
 			bserv::placeholders::session,
 			bserv::placeholders::response),
 		bserv::make_path("/users", &view_users,
-			bserv::placeholders::db_connection_ptr,
-			bserv::placeholders::session,
-			bserv::placeholders::response,
-			std::string{"1"}),
-		bserv::make_path("/users/<int>", &view_users,
-			bserv::placeholders::db_connection_ptr,
+			bserv::placeholders::db_read_connection_ptr,
 			bserv::placeholders::session,
 			bserv::placeholders::response,
-			bserv::placeholders::_1),
+			bserv::placeholders::params),
+		bserv::make_path("/users/export", &export_users,
+			bserv::placeholders::db_read_connection_ptr,
+			bserv::placeholders::response_writer),
 		bserv::make_path("/form_add_user", &form_add_user,
 			bserv::placeholders::request,
 			bserv::placeholders::response,
-			bserv::placeholders::json_params,
 			bserv::placeholders::db_connection_ptr,
 			bserv::placeholders::session),
 		}
@@ -131,6 +185,9 @@ int main(int argc, char* argv[]) {
 			// websocket example
 			bserv::make_path("/echo", &ws_echo,
 				bserv::placeholders::session,
+				bserv::placeholders::websocket_server_ptr),
+			bserv::make_path("/users/notifications", &ws_user_notifications,
+				bserv::placeholders::db_listener_ptr,
 				bserv::placeholders::websocket_server_ptr)
 		}
 	};
@@ -1,6 +1,8 @@
 #include "handlers.h"
 
 #include <vector>
+#include <chrono>
+#include <filesystem>
 
 #include "rendering.h"
 
@@ -35,12 +37,6 @@ std::optional<boost::json::object> get_user(
 	return orm_user.convert_to_optional(r);
 }
 
-std::string get_or_empty(
-	boost::json::object& obj,
-	const std::string& key) {
-	return obj.count(key) ? obj[key].as_string().c_str() : "";
-}
-
 // if you want to manually modify the response,
 // the return type should be `std::nullopt_t`,
 // and the return value should be `std::nullopt`.
@@ -80,35 +76,27 @@ std::nullopt_t hello(
 // is performed automatically.
 boost::json::object user_register(
 	bserv::request_type& request,
-	// the json object is obtained from the request body,
-	// as well as the url parameters
-	boost::json::object&& params,
+	// the fields are bound from the request body,
+	// as well as the url parameters (see `BSERV_PARAMS_FIELDS`).
+	// a missing `username` or `password` is rejected with 400
+	// before the handler is called.
+	register_request&& params,
 	std::shared_ptr<bserv::db_connection> conn) {
 	if (request.method() != boost::beast::http::verb::post) {
 		throw bserv::url_not_found_exception{};
 	}
-	if (params.count("username") == 0) {
-		return {
-			{"success", false},
-			{"message", "`username` is required"}
-		};
-	}
-	if (params.count("password") == 0) {
-		return {
-			{"success", false},
-			{"message", "`password` is required"}
-		};
-	}
-	auto username = params["username"].as_string();
+	const auto& username = params.username;
 	bserv::db_transaction tx{ conn };
-	auto opt_user = get_user(tx, username);
+	auto opt_user = get_user(tx, username.c_str());
 	if (opt_user.has_value()) {
 		return {
 			{"success", false},
 			{"message", "`username` existed"}
 		};
 	}
-	auto password = params["password"].as_string();
+	const auto& password = params.password;
+	// the cached queries on `auth_user` become stale after commit
+	tx.invalidate_on_commit("auth_user");
 	bserv::db_result r = tx.exec(
 		"insert into ? "
 		"(?, password, is_superuser, "
@@ -118,10 +106,12 @@ boost::json::object user_register(
 		username,
 		bserv::utils::security::encode_password(
 			password.c_str()), false,
-		get_or_empty(params, "first_name"),
-		get_or_empty(params, "last_name"),
-		get_or_empty(params, "email"), true);
+		params.first_name.value_or(""),
+		params.last_name.value_or(""),
+		params.email.value_or(""), true);
 	lginfo << r.query();
+	// the notification is delivered to the listeners on commit
+	tx.exec("select pg_notify(?, ?)", "auth_user", username);
 	tx.commit(); // you must manually commit changes
 	return {
 		{"success", true},
@@ -243,6 +233,13 @@ boost::json::object echo(
 	return { {"echo", params} };
 }
 
+// the body is spooled to a temporary file instead of being held in memory
+boost::json::object upload(
+	bserv::request_body_reader& body) {
+	std::string path = body.spool();
+	return { {"size", std::filesystem::file_size(path)} };
+}
+
 // websocket
 std::nullopt_t ws_echo(
 	std::shared_ptr<bserv::session_type> session,
@@ -260,11 +257,29 @@ std::nullopt_t ws_echo(
 	return std::nullopt;
 }
 
+// pushes the username of each registered user
+std::nullopt_t ws_user_notifications(
+	std::shared_ptr<bserv::db_listener> listener,
+	std::shared_ptr<bserv::websocket_server> ws_server) {
+	auto subscription = listener->subscribe("auth_user", ws_server->session());
+	while (true) {
+		try {
+			// the messages are only used to detect the closing
+			ws_server->read_view();
+		}
+		catch (bserv::websocket_closed&) {
+			break;
+		}
+	}
+	return std::nullopt;
+}
+
 
 std::nullopt_t serve_static_files(
-	bserv::response_type& response,
+	bserv::request_type& request,
+	bserv::response_writer& writer,
 	const std::string& path) {
-	return serve(response, path);
+	return serve(request, writer, path);
 }
 
 
@@ -307,84 +322,89 @@ std::nullopt_t form_logout(
 	return index("index.html", session_ptr, response, context);
 }
 
+// users are listed 10 per page, ordered by `id`
+bserv::db_keyset_paginator user_pages{ "auth_user", "id", 10, orm_user };
+
 std::nullopt_t redirect_to_users(
 	std::shared_ptr<bserv::db_connection> conn,
 	std::shared_ptr<bserv::session_type> session_ptr,
 	bserv::response_type& response,
-	int page_id,
+	const std::string& after,
+	const std::string& before,
 	boost::json::object&& context) {
-	lgdebug << "view users: " << page_id << std::endl;
+	lgdebug << "view users: after " << after << ", before " << before << std::endl;
 	bserv::db_transaction tx{ conn };
-	bserv::db_result db_res = tx.exec("select count(*) from auth_user;");
-	lginfo << db_res.query();
-	std::size_t total_users = (*db_res.begin())[0].as<std::size_t>();
+	// the count is cached, and dropped once a user is registered
+	std::size_t total_users = user_pages.count(tx, std::chrono::seconds{ 60 });
 	lgdebug << "total users: " << total_users << std::endl;
-	int total_pages = (int)total_users / 10;
-	if (total_users % 10 != 0) ++total_pages;
-	lgdebug << "total pages: " << total_pages << std::endl;
-	db_res = tx.exec("select * from auth_user limit 10 offset ?;", (page_id - 1) * 10);
-	lginfo << db_res.query();
-	auto users = orm_user.convert_to_vector(db_res);
+	bserv::db_page page = user_pages.fetch(tx, after, before);
 	boost::json::array json_users;
-	for (auto& user : users) {
+	for (auto& user : page.items) {
 		json_users.push_back(user);
 	}
 	boost::json::object pagination;
-	if (total_pages != 0) {
-		pagination["total"] = total_pages;
-		if (page_id > 1) {
-			pagination["previous"] = page_id - 1;
-		}
-		if (page_id < total_pages) {
-			pagination["next"] = page_id + 1;
-		}
-		int lower = page_id - 3;
-		int upper = page_id + 3;
-		if (page_id - 3 > 2) {
-			pagination["left_ellipsis"] = true;
-		}
-		else {
-			lower = 1;
-		}
-		if (page_id + 3 < total_pages - 1) {
-			pagination["right_ellipsis"] = true;
-		}
-		else {
-			upper = total_pages;
-		}
-		pagination["current"] = page_id;
-		boost::json::array pages_left;
-		for (int i = lower; i < page_id; ++i) {
-			pages_left.push_back(i);
-		}
-		pagination["pages_left"] = pages_left;
-		boost::json::array pages_right;
-		for (int i = page_id + 1; i <= upper; ++i) {
-			pages_right.push_back(i);
-		}
-		pagination["pages_right"] = pages_right;
-		context["pagination"] = pagination;
+	pagination["total"] = total_users;
+	if (page.previous.has_value()) {
+		pagination["previous"] = page.previous.value();
+	}
+	if (page.next.has_value()) {
+		pagination["next"] = page.next.value();
 	}
+	context["pagination"] = pagination;
 	context["users"] = json_users;
 	return index("users.html", session_ptr, response, context);
 }
 
+// the users are written as newline-delimited json, one page per chunk,
+// so the export does not have to be held in memory.
+std::nullopt_t export_users(
+	std::shared_ptr<bserv::db_connection> conn,
+	bserv::response_writer& writer) {
+	writer.response().set(bserv::http::field::content_type, "application/x-ndjson");
+	bserv::db_transaction tx{ conn };
+	std::string after;
+	std::string chunk;
+	while (true) {
+		bserv::db_page page = user_pages.fetch(tx, after);
+		chunk.clear();
+		for (auto& user : page.items) {
+			user.erase("password");
+			chunk += boost::json::serialize(user);
+			chunk += '\n';
+		}
+		writer.write(chunk);
+		if (!page.next.has_value()) break;
+		after = std::move(page.next.value());
+	}
+	writer.finish();
+	return std::nullopt;
+}
+
 std::nullopt_t view_users(
 	std::shared_ptr<bserv::db_connection> conn,
 	std::shared_ptr<bserv::session_type> session_ptr,
 	bserv::response_type& response,
-	const std::string& page_num) {
-	int page_id = std::stoi(page_num);
+	bserv::request_params& params) {
 	boost::json::object context;
-	return redirect_to_users(conn, session_ptr, response, page_id, std::move(context));
+	// only the query string is parsed, a malformed cursor is answered with 400
+	return redirect_to_users(conn, session_ptr, response,
+		std::string{ params.get_string("after") },
+		std::string{ params.get_string("before") },
+		std::move(context));
 }
 
 std::nullopt_t form_add_user(
 	bserv::request_type& request,
 	bserv::response_type& response,
-	boost::json::object&& params,
 	std::shared_ptr<bserv::db_connection> conn,
 	std::shared_ptr<bserv::session_type> session_ptr) {
-	boost::json::object context = user_register(request, std::move(params), conn);
-	return redirect_to_users(conn, session_ptr, response, 1, std::move(context));
+	// the errors are shown on the page instead of a 400
+	auto result = bserv::bind_params<register_request>(request);
+	boost::json::object context = result.ok()
+		? user_register(request, std::move(result.value), conn)
+		: boost::json::object{
+			{"success", false},
+			{"message", result.message()}
+		};
+	return redirect_to_users(conn, session_ptr, response, "", "", std::move(context));
 }
@@ -12,9 +12,19 @@ std::nullopt_t hello(
     bserv::response_type& response,
     std::shared_ptr<bserv::session_type> session_ptr);
 
+struct register_request {
+    std::string username;
+    std::string password;
+    std::optional<std::string> first_name;
+    std::optional<std::string> last_name;
+    std::optional<std::string> email;
+};
+BSERV_PARAMS_FIELDS(register_request,
+    username, password, first_name, last_name, email)
+
 boost::json::object user_register(
     bserv::request_type& request,
-    boost::json::object&& params,
+    register_request&& params,
     std::shared_ptr<bserv::db_connection> conn);
 
 boost::json::object user_login(
@@ -38,13 +48,21 @@ boost::json::object send_request(
 boost::json::object echo(
     boost::json::object&& params);
 
+boost::json::object upload(
+    bserv::request_body_reader& body);
+
 // websocket
 std::nullopt_t ws_echo(
     std::shared_ptr<bserv::session_type> session,
     std::shared_ptr<bserv::websocket_server> ws_server);
 
+std::nullopt_t ws_user_notifications(
+    std::shared_ptr<bserv::db_listener> listener,
+    std::shared_ptr<bserv::websocket_server> ws_server);
+
 std::nullopt_t serve_static_files(
-    bserv::response_type& response,
+    bserv::request_type& request,
+    bserv::response_writer& writer,
     const std::string& path);
 
 std::nullopt_t index_page(
@@ -66,11 +84,14 @@ std::nullopt_t view_users(
     std::shared_ptr<bserv::db_connection> conn,
     std::shared_ptr<bserv::session_type> session_ptr,
     bserv::response_type& response,
-    const std::string& page_num);
+    bserv::request_params& params);
+
+std::nullopt_t export_users(
+    std::shared_ptr<bserv::db_connection> conn,
+    bserv::response_writer& writer);
 
 std::nullopt_t form_add_user(
     bserv::request_type& request,
     bserv::response_type& response,
-    boost::json::object&& params,
     std::shared_ptr<bserv::db_connection> conn,
     std::shared_ptr<bserv::session_type> session_ptr);
@@ -32,7 +32,15 @@ std::nullopt_t render(
 }
 
 std::nullopt_t serve(
+	bserv::request_type& request,
 	bserv::response_type& response,
 	const std::string& file) {
-	return bserv::utils::file::serve(response, static_root_ + file);
+	return bserv::utils::file::serve(request, response, static_root_ + file);
+}
+
+std::nullopt_t serve(
+	bserv::request_type& request,
+	bserv::response_writer& writer,
+	const std::string& file) {
+	return bserv::utils::file::serve(request, writer, static_root_ + file);
 }
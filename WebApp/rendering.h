@@ -17,6 +17,13 @@ std::nullopt_t render(
 );
 
 std::nullopt_t serve(
+	bserv::request_type& request,
 	bserv::response_type& response,
 	const std::string& file
 );
+
+std::nullopt_t serve(
+	bserv::request_type& request,
+	bserv::response_writer& writer,
+	const std::string& file
+);
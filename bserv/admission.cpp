@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "bserv/admission.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace bserv {
+
+    admission_controller::admission_controller(
+        std::size_t max_connections,
+        std::size_t min_requests,
+        std::size_t max_requests,
+        std::chrono::milliseconds target_latency)
+        : max_connections_{ max_connections },
+        min_requests_{ (std::max)(min_requests, std::size_t{ 1 }) },
+        max_requests_{ (std::max)(max_requests, min_requests_) },
+        target_latency_{ target_latency },
+        connections_{ 0 }, requests_{ 0 },
+        limit_{ static_cast<double>(max_requests_) },
+        paused_{ false },
+        latency_{ 0 },
+        paused_count_{ 0 }, rejected_{ 0 } {}
+
+    void admission_controller::set_resume(std::function<void()> resume) {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        resume_ = std::move(resume);
+    }
+
+    bool admission_controller::try_acquire_connection() {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        if (connections_ >= max_connections_) {
+            if (!paused_) {
+                paused_ = true;
+                ++paused_count_;
+            }
+            return false;
+        }
+        ++connections_;
+        return true;
+    }
+
+    void admission_controller::release_connection() {
+        std::function<void()> resume;
+        {
+            std::lock_guard<std::mutex> lg{ lock_ };
+            --connections_;
+            if (paused_) {
+                paused_ = false;
+                resume = resume_;
+            }
+        }
+        if (resume) resume();
+    }
+
+    bool admission_controller::try_acquire_request() {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        if (requests_ >= static_cast<std::size_t>(limit_)) {
+            ++rejected_;
+            return false;
+        }
+        ++requests_;
+        return true;
+    }
+
+    void admission_controller::release_request(
+        std::optional<std::chrono::steady_clock::duration> latency) {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        --requests_;
+        if (!latency.has_value()) return;
+        // an exponential moving average, for the stats
+        latency_ += (latency.value() - latency_) / 8;
+        if (target_latency_.count() == 0) return;
+        if (latency.value() <= target_latency_) {
+            // additive increase: one for each `limit` requests
+            limit_ = (std::min)(limit_ + 1 / limit_, static_cast<double>(max_requests_));
+            return;
+        }
+        // multiplicative decrease, the requests in flight when the limit
+        // was decreased are not counted again
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_decrease_ < target_latency_) return;
+        last_decrease_ = now;
+        limit_ = (std::max)(limit_ * ADMISSION_DECREASE_FACTOR, static_cast<double>(min_requests_));
+    }
+
+    admission_stats admission_controller::stats() const {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        return {
+            connections_, requests_, static_cast<std::size_t>(limit_),
+            paused_count_, rejected_,
+            std::chrono::duration_cast<std::chrono::microseconds>(latency_)
+        };
+    }
+
+}  // bserv
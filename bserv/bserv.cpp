@@ -10,6 +10,15 @@
 #include <functional>
 #include <thread>
 #include <chrono>
+#include <cstdint>
+#include <limits>
+#include <array>
+#include <algorithm>
+#include <variant>
+#include <mutex>
+#include <atomic>
+
+#include <boost/version.hpp>
 
 #include "bserv/server.hpp"
 
@@ -17,6 +26,11 @@
 #include "bserv/utils.hpp"
 #include "bserv/client.hpp"
 #include "bserv/websocket.hpp"
+#include "bserv/stream.hpp"
+#include "bserv/headers.hpp"
+#include "bserv/memory.hpp"
+#include "bserv/admission.hpp"
+#include "bserv/rate_limit.hpp"
 
 namespace bserv {
 
@@ -27,72 +41,152 @@ namespace bserv {
 		return addr;
 	}
 
-	http::response<http::string_body> handle_request(
-		http::request<http::string_body>& req, router& routes,
+	// the target without the query string
+	std::string get_url(boost::string_view target) {
+		auto pos = target.find('?');
+		if (pos == boost::string_view::npos) return std::string{ target };
+		return std::string{ target.substr(0, pos) };
+	}
+
+	// the error responses with fixed bodies are serialized once
+
+	const prebuilt_response& not_found_response() {
+		// the target is not echoed, so that the body does not depend on it
+		static const prebuilt_response res{
+			http::status::not_found, "The requested url does not exist." };
+		return res;
+	}
+
+	// the rest of the body is not read, so the connection should be closed
+	const prebuilt_response& payload_too_large_response() {
+		static const prebuilt_response res{
+			http::status::payload_too_large, "Request body is too large." };
+		return res;
+	}
+
+	// the load beyond the limit of the requests is shed with this
+	const prebuilt_response& service_unavailable_response() {
+		static const prebuilt_response res{
+			http::status::service_unavailable, "Service is overloaded.",
+			{ { http::field::retry_after, std::to_string(ADMISSION_RETRY_AFTER) } } };
+		return res;
+	}
+
+	const prebuilt_response& too_many_requests_response() {
+		static const prebuilt_response res{
+			http::status::too_many_requests, "Too many requests.",
+			{ { http::field::retry_after, std::to_string(RATE_LIMIT_RETRY_AFTER) } } };
+		return res;
+	}
+
+	const prebuilt_response& too_many_websockets_response() {
+		static const prebuilt_response res{
+			http::status::service_unavailable, "Too many websocket connections." };
+		return res;
+	}
+
+	// the response of `handle_request`, `std::monostate`
+	// if the response has been streamed by the writer
+	using handled_response = std::variant<
+		std::monostate,
+		response_type*,
+		const prebuilt_response*>;
+
+	// `res` is passed to the handler, and `writer` streams it.
+	// it is filled in place (the response of an error as well),
+	// so that the memory of its fields and body is reused
+	// by a connection, and a pointer to it is returned.
+	// `body_reader` reads the body of a streaming route.
+	// `address` is the address of the client ("ip:port").
+	handled_response handle_request(
+		request_type& req,
+		response_type& res, router& routes,
 		std::shared_ptr<websocket_session> ws_session,
+		response_writer* writer,
+		request_body_reader* body_reader,
+		const std::string& address,
 		asio::io_context& ioc, asio::yield_context& yield) {
 
-		const auto bad_request = [&req](beast::string_view why) {
-			http::response<http::string_body> res{
-				http::status::bad_request, req.version() };
+		// clears the response without releasing its memory
+		const auto reset = [&req, &res](
+			http::status status, beast::string_view content_type) {
+			res.clear();
+			res.body().clear();
+			res.result(status);
+			res.reason({});
+			res.version(req.version());
 			res.set(http::field::server, NAME);
-			res.set(http::field::content_type, "text/html");
+			res.set(http::field::date, http_date());
+			res.set(http::field::content_type, content_type);
 			res.keep_alive(req.keep_alive());
-			res.body() = std::string{ why };
-			res.prepare_payload();
-			return res;
 		};
 
-		const auto not_found = [&req](beast::string_view target) {
-			http::response<http::string_body> res{
-				http::status::not_found, req.version() };
-			res.set(http::field::server, NAME);
-			res.set(http::field::content_type, "text/html");
-			res.keep_alive(req.keep_alive());
-			res.body() = "The requested url '"
-				+ std::string{ target } + "' does not exist.";
-			res.prepare_payload();
-			return res;
+		// the response of an error is built after the handler returns
+		std::optional<http::status> error;
+		std::string error_body;
+		const auto bad_request = [&](beast::string_view why) {
+			error = http::status::bad_request;
+			error_body = std::string{ why };
 		};
-
-		const auto server_error = [&req](beast::string_view what) {
-			http::response<http::string_body> res{
-				http::status::internal_server_error, req.version() };
-			res.set(http::field::server, NAME);
-			res.set(http::field::content_type, "text/html");
-			res.keep_alive(req.keep_alive());
-			res.body() = "Internal server error: " + std::string{ what };
-			res.prepare_payload();
-			return res;
+		const auto server_error = [&](beast::string_view what) {
+			error = http::status::internal_server_error;
+			error_body = "Internal server error: " + std::string{ what };
 		};
 
-		boost::string_view target = req.target();
-		auto pos = target.find('?');
-		boost::string_view url;
-		if (pos == boost::string_view::npos) url = target;
-		else url = target.substr(0, pos);
+		std::string url = get_url(req.target());
 
-		http::response<http::string_body> res{
-			http::status::ok, req.version() };
-		res.set(http::field::server, NAME);
-		res.set(http::field::content_type, "application/json");
-		res.keep_alive(req.keep_alive());
+		reset(http::status::ok, "application/json");
 
 		std::optional<boost::json::value> val;
+		const prebuilt_response* prebuilt = nullptr;
 		try {
-			val = routes(ioc, yield, ws_session, std::string{ url }, req, res);
+			val = routes(ioc, yield, ws_session, writer, body_reader, address, url, req, res);
 		}
 		catch (const url_not_found_exception& /*e*/) {
-			return not_found(url);
+			prebuilt = &not_found_response();
+		}
+		catch (const bad_request_exception& e) {
+			bad_request(e.what());
+		}
+		catch (const invalid_cursor_exception& e) {
+			bad_request(e.what());
+		}
+		catch (const response_stream_closed& e) {
+			lgdebug << "handle_request: " << e.what() << ": " << url;
+		}
+		catch (const payload_too_large_exception& /*e*/) {
+			prebuilt = &payload_too_large_response();
+		}
+		catch (const too_many_requests_exception& /*e*/) {
+			prebuilt = &too_many_requests_response();
 		}
-		catch (const bad_request_exception& /*e*/) {
-			return bad_request("Request body is not a valid JSON string.");
+		catch (const request_stream_closed& /*e*/) {
+			bad_request("Request body is incomplete.");
 		}
 		catch (const std::exception& e) {
-			return server_error(e.what());
+			server_error(e.what());
 		}
 		catch (...) {
-			return server_error("Unknown exception.");
+			server_error("Unknown exception.");
+		}
+
+		// the header has been sent, so nothing else can be sent
+		if (writer != nullptr && writer->started()) {
+			if (error.has_value() || prebuilt != nullptr)
+				lgerror << "handle_request: error after the response is started: "
+				<< (prebuilt != nullptr ? prebuilt->body() : error_body);
+			try {
+				writer->finish();
+			}
+			catch (const response_stream_closed& /*e*/) {}
+			return std::monostate{};
+		}
+		if (prebuilt != nullptr) return prebuilt;
+		if (error.has_value()) {
+			reset(error.value(), "text/html");
+			res.body() = std::move(error_body);
+			res.prepare_payload();
+			return &res;
 		}
 
 		if (val.has_value()) {
@@ -100,33 +194,104 @@ namespace bserv {
 			res.prepare_payload();
 		}
 
-		return res;
+		const server_resources& resources = routes.resources();
+		utils::compression::compress_response(
+			req, res,
+			resources.compression_level,
+			resources.compression_threshold);
+
+		return &res;
 	}
 
+	// a connection to be closed when the server shuts down
+	class drainable {
+	private:
+		friend class connection_registry;
+		drainable* prev_ = nullptr;
+		drainable* next_ = nullptr;
+		bool registered_ = false;
+	public:
+		virtual ~drainable() = default;
+		// called once when the server starts draining (or when it is
+		// added after that), with the lock of the registry held,
+		// so it should not block.
+		virtual void drain() = 0;
+	};
+
+	// the open connections, in an intrusive list
+	// so that adding one does not allocate
+	class connection_registry {
+	private:
+		std::mutex lock_;
+		drainable* head_;
+		std::atomic<bool> draining_;
+	public:
+		connection_registry() : head_{ nullptr }, draining_{ false } {}
+		connection_registry(const connection_registry&) = delete;
+		connection_registry& operator=(const connection_registry&) = delete;
+		void add(drainable& c) {
+			std::lock_guard<std::mutex> lg{ lock_ };
+			c.registered_ = true;
+			c.next_ = head_;
+			if (head_ != nullptr) head_->prev_ = &c;
+			head_ = &c;
+			if (draining_) c.drain();
+		}
+		// it should be called before `c` is destroyed
+		void remove(drainable& c) {
+			std::lock_guard<std::mutex> lg{ lock_ };
+			if (!c.registered_) return;
+			c.registered_ = false;
+			if (c.prev_ != nullptr) c.prev_->next_ = c.next_;
+			else head_ = c.next_;
+			if (c.next_ != nullptr) c.next_->prev_ = c.prev_;
+			c.prev_ = c.next_ = nullptr;
+		}
+		void drain() {
+			std::lock_guard<std::mutex> lg{ lock_ };
+			if (draining_.exchange(true)) return;
+			for (drainable* c = head_; c != nullptr; c = c->next_)
+				c->drain();
+		}
+		bool draining() const { return draining_.load(std::memory_order_relaxed); }
+	};
+
 	class websocket_session_server;
 
 	void handle_websocket_request(
 		std::shared_ptr<websocket_session_server>,
 		std::shared_ptr<websocket_session> session,
-		http::request<http::string_body>& req, router& routes,
+		request_type& req, router& routes,
 		asio::io_context& ioc, asio::yield_context yield);
 
 	class websocket_session_server
-		: public std::enable_shared_from_this<websocket_session_server> {
+		: public std::enable_shared_from_this<websocket_session_server>,
+		private drainable {
 	private:
 		friend websocket_server;
 		std::string address_;
 		std::shared_ptr<websocket_session> session_;
-		http::request<http::string_body> req_;
+		request_type req_;
 		router& routes_;
+		std::shared_ptr<websocket_limiter> limiter_;
+		std::shared_ptr<connection_registry> registry_;
+		// the client receives a close frame when the server shuts down
+		void drain() override {
+			if (auto self = weak_from_this().lock())
+				self->session_->close(websocket::close_code::going_away);
+		}
 		void on_accept(beast::error_code ec) {
 			if (ec) {
 				fail(ec, "websocket_session_server accept");
 				return;
 			}
-			// handles request here
+			registry_->add(*this);
+			session_->start_idle_timer(limiter_->idle_timeout());
+			// handles request here.
+			// the coroutine runs on the strand of the stream,
+			// so that it is serialized with the queued writes.
 			asio::spawn(
-				session_->ioc_,
+				session_->ws_.get_executor(),
 				std::bind(
 					&handle_websocket_request,
 					shared_from_this(),
@@ -144,23 +309,33 @@ namespace bserv {
 		explicit websocket_session_server(
 			asio::io_context& ioc,
 			tcp::socket&& socket,
-			http::request<http::string_body>&& req,
-			router& routes)
+			request_type&& req,
+			router& routes,
+			// a slot has been acquired from `limiter` for `ip`
+			std::shared_ptr<websocket_limiter> limiter,
+			const std::string& ip,
+			std::shared_ptr<connection_registry> registry)
 			: address_{ get_address(socket) },
 			session_{ std::make_shared<
 				websocket_session>(address_, ioc, std::move(socket)) },
-			req_{ std::move(req) }, routes_{ routes } {
+			req_{ std::move(req) }, routes_{ routes }, limiter_{ limiter },
+			registry_{ registry } {
+			session_->set_limiter(limiter_, ip);
 			lgtrace << "websocket_session_server opened: " << address_;
 		}
 		~websocket_session_server() {
+			registry_->remove(*this);
 			lgtrace << "websocket_session_server closed: " << address_;
 		}
 		// starts the asynchronous accept operation
 		void do_accept() {
-			// sets suggested timeout settings for the websocket
-			session_->ws_.set_option(
-				websocket::stream_base::timeout::suggested(
-					beast::role_type::server));
+			// sets suggested timeout settings for the websocket,
+			// a ping is sent if nothing is received for the ping interval
+			auto timeout = websocket::stream_base::timeout::suggested(
+				beast::role_type::server);
+			timeout.idle_timeout = 2 * limiter_->ping_interval();
+			timeout.keep_alive_pings = true;
+			session_->ws_.set_option(timeout);
 			// sets a decorator to change the Server of the handshake
 			session_->ws_.set_option(
 				websocket::stream_base::decorator(
@@ -169,6 +344,19 @@ namespace bserv {
 							http::field::server,
 							std::string{ BOOST_BEAST_VERSION_STRING } + " websocket-server");
 					}));
+			// the extensions are negotiated in the handshake
+			const route_options* options = routes_.find_options(get_url(req_.target()));
+			if (options != nullptr) session_->set_codec(options->codec);
+			if (options != nullptr && options->deflate) {
+				websocket::permessage_deflate pmd;
+				pmd.server_enable = true;
+				pmd.server_max_window_bits = options->deflate_window_bits;
+				pmd.memLevel = options->deflate_mem_level;
+#if BOOST_VERSION >= 107600
+				pmd.msg_size_threshold = options->deflate_threshold;
+#endif
+				session_->ws_.set_option(pmd);
+			}
 			// accepts the websocket handshake
 			session_->ws_.async_accept(
 				req_,
@@ -181,59 +369,416 @@ namespace bserv {
 	void handle_websocket_request(
 		std::shared_ptr<websocket_session_server>,
 		std::shared_ptr<websocket_session> session,
-		http::request<http::string_body>& req, router& routes,
+		request_type& req, router& routes,
 		asio::io_context& ioc, asio::yield_context yield) {
-		handle_request(req, routes, session, ioc, yield);
+		response_type res;
+		handle_request(req, res, routes, session, nullptr, nullptr, session->address_, ioc, yield);
 	}
 
-	std::string websocket_server::read() {
+	std::string_view websocket_server::read_view() {
 		beast::error_code ec;
-		beast::flat_buffer buffer;
+		auto& buffer = session_->read_buffer_;
+		// the previous message is no longer referred to
+		buffer.consume(buffer.size());
 		// reads a message into the buffer
-		session_.ws_.async_read(buffer, yield_[ec]);
-		lgtrace << "websocket_server: read from " << session_.address_;
+		session_->ws_.async_read(buffer, yield_[ec]);
+		lgtrace << "websocket_server: read from " << session_->address_;
+		session_->last_active_ = std::chrono::steady_clock::now();
 		// this indicates that the session was closed
 		if (ec == websocket::error::closed) {
 			throw websocket_closed{};
 		}
+		// the pings were not answered
+		if (ec == beast::error::timeout && session_->limiter_ != nullptr) {
+			session_->limiter_->on_timed_out();
+		}
 		if (ec) {
 			fail(ec, "websocket_server read");
 			throw websocket_io_exception{ "websocket_server read: " + ec.message() };
 		}
 		// lgtrace << "websocket_server: received text? " << ws_.got_text() << " from " << address_;
-		return beast::buffers_to_string(buffer.data());
+		// the data of a `flat_buffer` is contiguous
+		auto data = buffer.data();
+		return { static_cast<const char*>(data.data()), data.size() };
+	}
+
+	boost::json::value websocket_server::read_json(boost::json::storage_ptr sp) {
+		std::string_view message = read_view();
+		if (got_binary()) return msgpack::decode(message, std::move(sp));
+		auto& parser = session_->parser_;
+		boost::system::error_code ec;
+		parser.reset(std::move(sp));
+		parser.write(message, ec);
+		if (ec) throw boost::system::system_error{ ec };
+		return parser.release();
 	}
 
 	void websocket_server::write(const std::string& data) {
-		beast::error_code ec;
-		// ws_.text(ws_.got_text());
-		session_.ws_.async_write(asio::buffer(data), yield_[ec]);
-		lgtrace << "websocket_server: write to " << session_.address_;
+		// applies backpressure when the client does not keep up
+		session_->wait_writable(yield_);
+		if (session_->closed()) {
+			throw websocket_io_exception{ "websocket_server write: session closed" };
+		}
+		session_->send(std::make_shared<const std::string>(data));
+		lgtrace << "websocket_server: write to " << session_->address_;
+	}
+
+	void websocket_server::write_binary(const std::string& data) {
+		session_->wait_writable(yield_);
+		if (session_->closed()) {
+			throw websocket_io_exception{ "websocket_server write: session closed" };
+		}
+		session_->send(std::make_shared<const std::string>(data), true);
+		lgtrace << "websocket_server: write binary to " << session_->address_;
+	}
+
+	void websocket_server::write_json(const boost::json::value& val) {
+		session_->wait_writable(yield_);
+		if (session_->closed()) {
+			throw websocket_io_exception{ "websocket_server write: session closed" };
+		}
+		bool binary = session_->codec() == message_codec::msgpack;
+		encoded_.clear();
+		if (binary) msgpack::encode(val, encoded_);
+		else {
+			json::serializer sr;
+			sr.reset(&val);
+			while (!sr.done()) {
+				std::size_t size = encoded_.size();
+				encoded_.resize((std::max)(encoded_.capacity(), size + 512));
+				size += sr.read(&encoded_[size], encoded_.size() - size).size();
+				encoded_.resize(size);
+			}
+		}
+		if (!session_->write_direct(encoded_, binary, yield_))
+			session_->send(std::make_shared<const std::string>(encoded_), binary);
+		lgtrace << "websocket_server: write json to " << session_->address_;
+	}
+
+	bool websocket_limiter::try_acquire(const std::string& ip) {
+		std::lock_guard<std::mutex> lg{ lock_ };
+		if (sessions_ >= max_sessions_) {
+			++rejected_;
+			return false;
+		}
+		auto& count = sessions_per_ip_[ip];
+		if (count >= max_sessions_per_ip_) {
+			++rejected_per_ip_;
+			return false;
+		}
+		++count;
+		++sessions_;
+		return true;
+	}
+
+	void websocket_limiter::release(const std::string& ip) {
+		std::lock_guard<std::mutex> lg{ lock_ };
+		--sessions_;
+		auto it = sessions_per_ip_.find(ip);
+		if (it != sessions_per_ip_.end() && --it->second == 0)
+			sessions_per_ip_.erase(it);
+	}
+
+	websocket_stats websocket_limiter::stats() const {
+		std::lock_guard<std::mutex> lg{ lock_ };
+		return {
+			sessions_, rejected_, rejected_per_ip_,
+			reaped_.load(), timed_out_.load()
+		};
+	}
+
+	void websocket_session::start_idle_timer(std::chrono::seconds idle_timeout) {
+		idle_timeout_ = idle_timeout;
+		last_active_ = std::chrono::steady_clock::now();
+		if (idle_timeout_.count() > 0) do_idle_wait();
+	}
+
+	void websocket_session::do_idle_wait() {
+		idle_timer_.expires_at(last_active_ + idle_timeout_);
+		// the timer does not keep the session alive
+		idle_timer_.async_wait(
+			[weak = weak_from_this()](beast::error_code ec) {
+				if (auto self = weak.lock()) self->on_idle(ec);
+			});
+	}
+
+	void websocket_session::on_idle(beast::error_code ec) {
+		if (ec || closed()) return;
+		if (std::chrono::steady_clock::now() < last_active_ + idle_timeout_) {
+			do_idle_wait();
+			return;
+		}
+		lgdebug << "websocket_session: closing idle session " << address_;
+		if (limiter_ != nullptr) limiter_->on_reaped();
+		close(websocket::close_code::going_away);
+	}
+
+	websocket_session::~websocket_session() {
+		if (limiter_ != nullptr) limiter_->release(ip_);
+		node* head = incoming_.exchange(nullptr);
+		while (head != nullptr) {
+			node* next = head->next_;
+			delete head;
+			head = next;
+		}
+	}
+
+	void websocket_session::send(std::shared_ptr<const std::string> message, bool binary) {
+		if (failed_.load(std::memory_order_relaxed)) return;
+		bytes_buffered_.fetch_add(message->size(), std::memory_order_relaxed);
+		queue_size_.fetch_add(1, std::memory_order_relaxed);
+		node* n = new node{ { std::move(message), binary }, incoming_.load(std::memory_order_relaxed) };
+		while (!incoming_.compare_exchange_weak(
+			n->next_, n,
+			std::memory_order_release,
+			std::memory_order_relaxed));
+		// at most one drain is scheduled at a time
+		if (!drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+			asio::post(
+				ws_.get_executor(),
+				beast::bind_front_handler(
+					&websocket_session::drain,
+					shared_from_this()));
+		}
+	}
+
+	void websocket_session::close(websocket::close_code code) {
+		failed_ = true;
+		asio::dispatch(
+			ws_.get_executor(),
+			[self = shared_from_this(), code]() {
+				if (self->closing_) return;
+				self->closing_ = true;
+				self->close_code_ = code;
+				self->notify_writable();
+				if (!self->writing_) {
+					self->discard_queue();
+					self->do_close();
+				}
+			});
+	}
+
+	void websocket_session::wait_writable(asio::yield_context& yield) {
+		while (!writable() && !closed()) {
+			beast::error_code ec;
+			writable_.expires_at(asio::steady_timer::time_point::max());
+			// cancelled by `notify_writable`
+			writable_.async_wait(yield[ec]);
+		}
+	}
+
+	void websocket_session::notify_writable() {
+		writable_.cancel();
+	}
+
+	void websocket_session::drain() {
+		// the messages sent after this are drained by the next call
+		drain_scheduled_.store(false, std::memory_order_release);
+		node* head = incoming_.exchange(nullptr, std::memory_order_acquire);
+		// reverses the list to restore the order of the messages
+		node* reversed = nullptr;
+		while (head != nullptr) {
+			node* next = head->next_;
+			head->next_ = reversed;
+			reversed = head;
+			head = next;
+		}
+		while (reversed != nullptr) {
+			node* next = reversed->next_;
+			queue_.emplace_back(std::move(reversed->message_));
+			delete reversed;
+			reversed = next;
+		}
+		// the messages are discarded after a failure or `close`
+		if (closing_ || closed()) {
+			if (!writing_) discard_queue();
+			return;
+		}
+		if (!writing_ && !queue_.empty()) do_write();
+	}
+
+	void websocket_session::discard_queue() {
+		std::size_t bytes = 0;
+		for (const auto& message : queue_) bytes += message.data_->size();
+		bytes_buffered_.fetch_sub(bytes, std::memory_order_relaxed);
+		queue_size_.fetch_sub(queue_.size(), std::memory_order_relaxed);
+		queue_.clear();
+	}
+
+	void websocket_session::do_write() {
+		writing_ = true;
+		in_flight_ = 1;
+		in_flight_bytes_ = queue_.front().data_->size();
+		ws_.binary(queue_.front().binary_);
+		// a message containing '\n' cannot be split by the client,
+		// so it is written alone (compact json never contains one)
+		auto coalescible = [](const outbound& message) {
+			return !message.binary_
+				&& message.data_->find('\n') == std::string::npos;
+		};
+		if (coalesce_limit_ == 0
+			|| queue_.size() == 1
+			|| in_flight_bytes_ >= coalesce_limit_
+			|| !coalescible(queue_.front())) {
+			ws_.async_write(
+				asio::buffer(*queue_.front().data_),
+				beast::bind_front_handler(
+					&websocket_session::on_write,
+					shared_from_this()));
+			return;
+		}
+		// joins the small messages to save the per-message overhead
+		coalesced_.assign(*queue_.front().data_);
+		while (in_flight_ < queue_.size()
+			&& coalesced_.size() + 1 + queue_[in_flight_].data_->size() <= coalesce_limit_
+			&& coalescible(queue_[in_flight_])) {
+			coalesced_ += '\n';
+			coalesced_ += *queue_[in_flight_].data_;
+			in_flight_bytes_ += queue_[in_flight_].data_->size();
+			++in_flight_;
+		}
+		ws_.async_write(
+			asio::buffer(coalesced_),
+			beast::bind_front_handler(
+				&websocket_session::on_write,
+				shared_from_this()));
+	}
+
+	void websocket_session::on_write(
+		beast::error_code ec, std::size_t bytes_transferred) {
+		boost::ignore_unused(bytes_transferred);
+		writing_ = false;
+		last_active_ = std::chrono::steady_clock::now();
+		queue_.erase(queue_.begin(), queue_.begin() + in_flight_);
+		queue_size_.fetch_sub(in_flight_, std::memory_order_relaxed);
+		bytes_buffered_.fetch_sub(in_flight_bytes_, std::memory_order_relaxed);
 		if (ec) {
-			fail(ec, "websocket_server write");
-			throw websocket_io_exception{ "websocket_server write: " + ec.message() };
+			fail(ec, "websocket_session write");
+			failed_ = true;
+			discard_queue();
+			notify_writable();
+			return;
+		}
+		if (bytes_buffered() < high_water_mark() / 2) notify_writable();
+		if (closing_) {
+			discard_queue();
+			do_close();
+			return;
 		}
+		if (!queue_.empty()) do_write();
+	}
+
+	bool websocket_session::write_direct(
+		const std::string& data, bool binary, asio::yield_context& yield) {
+		if (writing_ || closing_ || closed() || !queue_.empty()
+			|| incoming_.load(std::memory_order_acquire) != nullptr)
+			return false;
+		// nothing is in flight from the queue,
+		// the messages queued meanwhile are written by `on_write`
+		writing_ = true;
+		in_flight_ = 0;
+		in_flight_bytes_ = 0;
+		ws_.binary(binary);
+		beast::error_code ec;
+		std::size_t bytes_transferred = ws_.async_write(asio::buffer(data), yield[ec]);
+		on_write(ec, bytes_transferred);
+		return true;
+	}
+
+	void websocket_session::do_close() {
+		writing_ = true;
+		ws_.async_close(
+			close_code_,
+			[self = shared_from_this()](beast::error_code ec) {
+				if (ec) fail(ec, "websocket_session close");
+			});
 	}
 
 
 	class http_session;
 
+	// a request admitted by `admission_controller`, which is released
+	// once: when it is handled, when its response starts streaming (the
+	// slot is not held for the lifetime of a stream), or on unwinding.
+	class request_slot {
+	private:
+		admission_controller& admission_;
+		const std::chrono::steady_clock::time_point start_;
+		bool released_;
+	public:
+		request_slot(
+			admission_controller& admission,
+			std::chrono::steady_clock::time_point start)
+			: admission_{ admission }, start_{ start }, released_{ false } {}
+		request_slot(const request_slot&) = delete;
+		request_slot& operator=(const request_slot&) = delete;
+		~request_slot() { release(false); }
+		// its latency adjusts the limit if `measured`
+		void release(bool measured) {
+			if (released_) return;
+			released_ = true;
+			std::optional<std::chrono::steady_clock::duration> latency;
+			if (measured) latency = std::chrono::steady_clock::now() - start_;
+			admission_.release_request(latency);
+		}
+	};
+
 	// this function produces an HTTP response for the given
-	// request. The type of the response object depends on the
-	// contents of the request, so the interface requires the
-	// caller to pass a generic lambda for receiving the response.
+	// request. The response of the session (`send.response()`)
+	// is filled in place, and `send` writes it.
 	// NOTE: `send` should be called only once!
 	template <class Send>
 	void handle_http_request(
 		std::shared_ptr<http_session>,
-		http::request<http::string_body> req,
+		request_type req,
 		Send& send, router& routes, asio::io_context& ioc, asio::yield_context yield) {
-		send(handle_request(req, routes, nullptr, ioc, yield));
+		request_slot slot{ send.admission(), send.request_start() };
+		response_type& res = send.response();
+		response_writer writer{ send.stream(), req, res, yield };
+		writer.on_start([&slot] { slot.release(false); });
+		auto ret = handle_request(req, res, routes, nullptr, &writer, nullptr, send.address(), ioc, yield);
+		// before the response is sent, after which the next request is read.
+		// a stream has released it when it started, unmeasured.
+		slot.release(!writer.started());
+		send.recycle(std::move(req.body()));
+		if (std::holds_alternative<response_type*>(ret))
+			send();
+		else if (auto prebuilt = std::get_if<const prebuilt_response*>(&ret))
+			send.prebuilt(**prebuilt, req.version(), req.keep_alive());
+		else send.streamed(writer.need_eof());
+	}
+
+	// handles a request on a streaming route,
+	// the body of which is read by the handler through `parser`.
+	template <class Send>
+	void handle_streaming_http_request(
+		std::shared_ptr<http_session>,
+		std::shared_ptr<http::request_parser<http::buffer_body, pool_allocator<char>>> parser,
+		Send& send, router& routes, asio::io_context& ioc, asio::yield_context yield) {
+		request_slot slot{ send.admission(), send.request_start() };
+		request_type req{ parser->get().base() };
+		response_type& res = send.response();
+		response_writer writer{ send.stream(), req, res, yield };
+		writer.on_start([&slot] { slot.release(false); });
+		request_body_reader body_reader{ send.stream(), send.buffer(), *parser, yield };
+		auto ret = handle_request(req, res, routes, nullptr, &writer, &body_reader, send.address(), ioc, yield);
+		// the latency of a streaming request depends on the size of its body
+		slot.release(false);
+		// the next request cannot be read if the body is not read to the end
+		bool incomplete = !body_reader.done() || body_reader.failed();
+		if (std::holds_alternative<response_type*>(ret)) {
+			if (incomplete) res.keep_alive(false);
+			send();
+		}
+		else if (auto prebuilt = std::get_if<const prebuilt_response*>(&ret))
+			send.prebuilt(**prebuilt, req.version(), req.keep_alive() && !incomplete);
+		else send.streamed(writer.need_eof() || incomplete);
 	}
 
 	// handles an HTTP server connection
 	class http_session
-		: public std::enable_shared_from_this<http_session> {
+		: public std::enable_shared_from_this<http_session>,
+		private drainable {
 	private:
 		// the function object is used to send an HTTP message.
 		class send_lambda {
@@ -242,50 +787,292 @@ namespace bserv {
 		public:
 			send_lambda(http_session& self)
 				: self_{ self } {}
-			template <bool isRequest, class Body, class Fields>
-			void operator()(
-				http::message<isRequest, Body, Fields>&& msg) const {
-				// the lifetime of the message has to extend
-				// for the duration of the async operation so
-				// we use a shared_ptr to manage it.
-				auto sp = std::make_shared<
-					http::message<isRequest, Body, Fields>>(
-						std::move(msg));
-				// stores a type-erased version of the shared
-				// pointer in the class to keep it alive.
-				self_.res_ = sp;
+			// the response of the session, filled by the handler
+			response_type& response() const { return self_.response_; }
+			// writes the response of the session, which is kept
+			// for the duration of the async operation
+			void operator()() const {
+				if (self_.registry_->draining()) self_.response_.keep_alive(false);
 				// writes the response
 				http::async_write(
-					self_.stream_, *sp,
-					beast::bind_front_handler(
-						&http_session::on_write,
-						self_.shared_from_this(),
-						sp->need_eof()));
+					self_.stream_, self_.response_,
+					bind_handler_memory(self_.memory_,
+						beast::bind_front_handler(
+							&http_session::on_write,
+							self_.shared_from_this(),
+							self_.response_.need_eof())));
+			}
+			// writes a prebuilt response with the cached `Date`
+			void prebuilt(
+				const prebuilt_response& res,
+				unsigned version, bool keep_alive) const {
+				keep_alive = keep_alive && !self_.registry_->draining();
+				auto date = http_date();
+				std::copy(date.begin(), date.end(), self_.date_.begin());
+				asio::async_write(
+					self_.stream_,
+					res.buffers(version, keep_alive, self_.date_.data()),
+					bind_handler_memory(self_.memory_,
+						beast::bind_front_handler(
+							&http_session::on_write,
+							self_.shared_from_this(),
+							!keep_alive)));
+			}
+			// for the `request_slot` of the request admitted by `admit_request`
+			admission_controller& admission() const { return *self_.admission_; }
+			std::chrono::steady_clock::time_point request_start() const { return self_.request_start_; }
+			// keeps the memory of the body of a request for the next one
+			void recycle(std::string&& body) const {
+				if (body.capacity() > REQUEST_BODY_RETAINED) return;
+				body.clear();
+				self_.body_ = std::move(body);
+			}
+			beast::tcp_stream& stream() const { return self_.stream_; }
+			beast::flat_buffer& buffer() const { return self_.buffer_; }
+			const std::string& address() const { return self_.address_; }
+			// the response has been written by a `response_writer`.
+			// the next read is started on the strand of the stream,
+			// where `on_drain` checks whether the session is idle.
+			void streamed(bool close) const {
+				asio::post(
+					self_.stream_.get_executor(),
+					bind_handler_memory(self_.memory_,
+						beast::bind_front_handler(
+							&http_session::on_write,
+							self_.shared_from_this(),
+							close || self_.registry_->draining(),
+							beast::error_code{}, 0)));
 			}
 		} lambda_;
 		asio::io_context& ioc_;
 		beast::tcp_stream stream_;
 		beast::flat_buffer buffer_;
 		boost::optional<
-			http::request_parser<http::string_body>> parser_;
-		std::shared_ptr<void> res_;
+			http::request_parser<http::string_body, pool_allocator<char>>> parser_;
+		// the body of the last request, whose capacity is reused
+		std::string body_;
+		// the response being handled or written, which is cleared
+		// in place after it is written, so that its fields (from
+		// `pool_allocator`) and its body are not allocated again
+		// for the next request
+		response_type response_;
+		// reused by the reads and writes, which do not overlap
+		handler_memory memory_;
+		// the `Date` of a prebuilt response being written
+		std::array<char, HTTP_DATE_SIZE> date_;
 		router& routes_;
 		router& ws_routes_;
+		std::shared_ptr<websocket_limiter> ws_limiter_;
+		std::shared_ptr<admission_controller> admission_;
+		// when the request being handled was admitted
+		std::chrono::steady_clock::time_point request_start_;
+		std::shared_ptr<connection_registry> registry_;
+		// waiting for the next request, on the strand of the stream
+		bool idle_;
 		const std::string address_;
+		// the coroutine handling the requests of the connection one after
+		// another, so that a coroutine (and its stack) is not created for
+		// each request. it is spawned with the first request and waits
+		// on `ready` for the next one, without keeping the session alive.
+		struct request_handler {
+			asio::steady_timer ready;
+			// set with the session by `on_read` when a request is read
+			std::shared_ptr<http_session> session;
+			// set by the destructor of the session
+			bool closed = false;
+			explicit request_handler(const beast::tcp_stream::executor_type& ex)
+				: ready{ ex } {}
+		};
+		std::shared_ptr<request_handler> handler_;
+		static void handle_requests(
+			std::shared_ptr<request_handler> handler,
+			asio::yield_context yield) {
+			for (;;) {
+				if (auto self = std::move(handler->session)) {
+					handle_http_request(
+						self, self->parser_->release(),
+						self->lambda_, self->routes_, self->ioc_, yield);
+					continue;
+				}
+				if (handler->closed) return;
+				// cancelled by `on_read` or the destructor of the session
+				beast::error_code ec;
+				handler->ready.expires_at(asio::steady_timer::time_point::max());
+				handler->ready.async_wait(yield[ec]);
+			}
+		}
+		void drain() override {
+			if (auto self = weak_from_this().lock())
+				asio::post(
+					stream_.get_executor(),
+					beast::bind_front_handler(
+						&http_session::on_drain,
+						std::move(self)));
+		}
+		// the requests being handled are answered with `Connection: close`,
+		// and an idle connection is given a short time for a request
+		// already on the way before it is closed.
+		void on_drain() {
+			if (idle_)
+				stream_.expires_after(std::chrono::milliseconds(SHUTDOWN_IDLE_GRACE));
+		}
+		// returns false if the request is answered with 503,
+		// otherwise the handler should hold a `request_slot`.
+		bool admit_request(bool keep_alive) {
+			if (!admission_->try_acquire_request()) {
+				lgwarning << "request rejected by the admission control: " << address_;
+				lambda_.prebuilt(service_unavailable_response(), parser_->get().version(), keep_alive);
+				return false;
+			}
+			request_start_ = std::chrono::steady_clock::now();
+			return true;
+		}
 		void do_read() {
 			// constructs a new parser for each message
 			parser_.emplace();
-			// applies a reasonable limit to the allowed size
-			// of the body in bytes to prevent abuse.
-			parser_->body_limit(PAYLOAD_LIMIT);
+			parser_->get().body() = std::move(body_);
+			// the body limit depends on the route,
+			// and it is applied once the header is read.
+			// (`boost::none` would reject any content length in some versions)
+			parser_->body_limit((std::numeric_limits<std::uint64_t>::max)());
 			// sets the timeout.
+			if (registry_->draining())
+				stream_.expires_after(std::chrono::milliseconds(SHUTDOWN_IDLE_GRACE));
+			else stream_.expires_after(std::chrono::seconds(EXPIRY_TIME));
+			idle_ = true;
+			// reads the header first, so that the route is
+			// found before the body is read
+			http::async_read_header(
+				stream_, buffer_, *parser_,
+				bind_handler_memory(memory_,
+					beast::bind_front_handler(
+						&http_session::on_read_header,
+						shared_from_this())));
+		}
+		void on_read_header(
+			beast::error_code ec,
+			std::size_t bytes_transferred) {
+			boost::ignore_unused(bytes_transferred);
+			idle_ = false;
+			// this means they closed the connection
+			if (ec == http::error::end_of_stream) {
+				do_close();
+				return;
+			}
+			// an idle connection is closed on shutdown
+			if (ec == beast::error::timeout && registry_->draining()
+				&& buffer_.size() == 0) {
+				lgtrace << "idle connection closed on shutdown: " << address_;
+				return;
+			}
+			if (ec) {
+				fail(ec, "http_session async_read_header");
+				return;
+			}
+			auto& header = parser_->get();
+
+			// sees if it is a websocket upgrade
+			if (websocket::is_upgrade(header)) {
+				do_upgrade();
+				return;
+			}
+
+			const route_options* options = nullptr;
+			if (!parser_->is_done() || routes_.has_streaming_routes())
+				options = routes_.find_options(get_url(header.target()));
+			bool streaming = options != nullptr && options->streaming;
+
+			// there is no body to read
+			if (!streaming && parser_->is_done()) {
+				on_read({}, bytes_transferred);
+				return;
+			}
+
+			std::uint64_t limit = options != nullptr && options->body_limit.has_value()
+				? options->body_limit.value()
+				: (streaming ? STREAMING_PAYLOAD_LIMIT : PAYLOAD_LIMIT);
+			// answers before the body is sent if the client expects `100 Continue`
+			auto length = parser_->content_length();
+			if (length.has_value() && length.value() > limit) {
+				lgwarning << "request body is too large: " << address_;
+				lambda_.prebuilt(payload_too_large_response(), header.version(), false);
+				return;
+			}
+			parser_->body_limit(limit);
+
+			if (streaming) {
+				// the body is not read if it is rejected
+				if (!admit_request(false)) return;
+				// the handler sends `100 Continue` when it reads the body
+				asio::spawn(
+					ioc_,
+					std::bind(
+						&handle_streaming_http_request<send_lambda>,
+						shared_from_this(),
+						std::make_shared<http::request_parser<http::buffer_body, pool_allocator<char>>>(
+							std::move(parser_.value())),
+						std::ref(lambda_),
+						std::ref(routes_),
+						std::ref(ioc_),
+						std::placeholders::_1)
+#ifdef _MSC_VER
+					// currently, it is only identified on windows
+					// that the default stack size is too small
+					, boost::coroutines::attributes{ STACK_SIZE }
+#endif
+				);
+				return;
+			}
+
+			if (beast::iequals(header[http::field::expect], "100-continue")) {
+				static const char continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+				asio::async_write(
+					stream_,
+					asio::buffer(continue_response, sizeof(continue_response) - 1),
+					[self = shared_from_this()](beast::error_code ec, std::size_t) {
+						if (ec) {
+							fail(ec, "http_session async_write");
+							return;
+						}
+						self->do_read_body();
+					});
+				return;
+			}
+			do_read_body();
+		}
+		void do_read_body() {
 			stream_.expires_after(std::chrono::seconds(EXPIRY_TIME));
-			// reads a request using the parser-oriented interface
+			// reads the rest of the request
 			http::async_read(
 				stream_, buffer_, *parser_,
-				beast::bind_front_handler(
-					&http_session::on_read,
-					shared_from_this()));
+				bind_handler_memory(memory_,
+					beast::bind_front_handler(
+						&http_session::on_read,
+						shared_from_this())));
+		}
+		void do_upgrade() {
+			beast::error_code ep_ec;
+			std::string ip = stream_.socket().remote_endpoint(ep_ec).address().to_string();
+			if (registry_->draining()) {
+				lambda_.prebuilt(service_unavailable_response(), parser_->get().version(), false);
+				return;
+			}
+			if (!ws_limiter_->try_acquire(ip)) {
+				lgwarning << "websocket upgrade rejected: " << address_;
+				lambda_.prebuilt(too_many_websockets_response(), parser_->get().version(), false);
+				return;
+			}
+			// creates a websocket session, transferring ownership
+			// of both the socket and the http request
+			std::make_shared<websocket_session_server>(
+				ioc_,
+				stream_.release_socket(),
+				parser_->release(),
+				ws_routes_,
+				ws_limiter_,
+				ip,
+				registry_
+				)->do_accept();
 		}
 		void on_read(
 			beast::error_code ec,
@@ -297,35 +1084,33 @@ namespace bserv {
 				do_close();
 				return;
 			}
+			if (ec == http::error::body_limit) {
+				lgwarning << "request body is too large: " << address_;
+				lambda_.prebuilt(payload_too_large_response(), parser_->get().version(), false);
+				return;
+			}
 			if (ec) {
 				fail(ec, "http_session async_read");
 				return;
 			}
 
-			// sees if it is a websocket upgrade
-			if (websocket::is_upgrade(parser_->get())) {
-				// creates a websocket session, transferring ownership
-				// of both the socket and the http request
-				std::make_shared<websocket_session_server>(
-					ioc_,
-					stream_.release_socket(),
-					parser_->release(),
-					ws_routes_
-					)->do_accept();
+			if (!admit_request(parser_->get().keep_alive())) return;
+
+			// handles the request and sends the response.
+			// the coroutine runs on the strand of the stream,
+			// and it takes the request from the parser.
+			if (handler_ != nullptr) {
+				handler_->session = shared_from_this();
+				handler_->ready.cancel();
 				return;
 			}
-
-			// handles the request and sends the response
-
+			handler_ = std::make_shared<request_handler>(stream_.get_executor());
+			handler_->session = shared_from_this();
 			asio::spawn(
-				ioc_,
+				stream_.get_executor(),
 				std::bind(
-					&handle_http_request<send_lambda>,
-					shared_from_this(),
-					parser_->release(),
-					std::ref(lambda_),
-					std::ref(routes_),
-					std::ref(ioc_),
+					&http_session::handle_requests,
+					handler_,
 					std::placeholders::_1)
 #ifdef _MSC_VER
 				// currently, it is only identified on windows
@@ -333,16 +1118,17 @@ namespace bserv {
 				, boost::coroutines::attributes{ STACK_SIZE }
 #endif
 			);
-			// handle_request(parser_->release(), lambda_, routes_);
-
-			// at this point the parser can be reset
 		}
 		void on_write(
 			bool close, beast::error_code ec,
 			std::size_t bytes_transferred) {
 			boost::ignore_unused(bytes_transferred);
-			// we're done with the response so delete it
-			res_.reset();
+			// we're done with the response, which is cleared in place
+			// for the next one (a large body is released)
+			response_.clear();
+			if (response_.body().capacity() > RESPONSE_BODY_RETAINED)
+				response_.body() = std::string{};
+			else response_.body().clear();
 			if (ec) {
 				fail(ec, "http_session async_write");
 				return;
@@ -369,19 +1155,36 @@ namespace bserv {
 			asio::io_context& ioc,
 			tcp::socket&& socket,
 			router& routes,
-			router& ws_routes)
+			router& ws_routes,
+			std::shared_ptr<websocket_limiter> ws_limiter,
+			// a connection has been acquired from `admission`
+			std::shared_ptr<admission_controller> admission,
+			std::shared_ptr<connection_registry> registry)
 			: lambda_{ *this },
 			ioc_{ ioc },
 			stream_{ std::move(socket) },
 			routes_{ routes },
 			ws_routes_{ ws_routes },
+			ws_limiter_{ ws_limiter },
+			admission_{ admission },
+			registry_{ registry },
+			idle_{ false },
 			address_{ get_address(stream_.socket()) } {
 			lgtrace << "http session opened: " << address_;
 		}
 		~http_session() {
+			registry_->remove(*this);
+			// the coroutine handling the requests ends
+			if (handler_ != nullptr) {
+				handler_->closed = true;
+				handler_->ready.cancel();
+			}
+			// an upgraded connection is counted by `websocket_limiter` instead
+			admission_->release_connection();
 			lgtrace << "http session closed: " << address_;
 		}
 		void run() {
+			registry_->add(*this);
 			asio::dispatch(
 				stream_.get_executor(),
 				beast::bind_front_handler(
@@ -398,7 +1201,18 @@ namespace bserv {
 		tcp::acceptor acceptor_;
 		router& routes_;
 		router& ws_routes_;
+		std::shared_ptr<websocket_limiter> ws_limiter_;
+		std::shared_ptr<admission_controller> admission_;
+		std::shared_ptr<connection_registry> registry_;
 		void do_accept() {
+			// the listener has been stopped
+			if (!acceptor_.is_open()) return;
+			// pauses at the cap of the connections,
+			// and resumes when a connection is closed (see `run`)
+			if (!admission_->try_acquire_connection()) {
+				lgwarning << "listener paused: too many connections";
+				return;
+			}
 			acceptor_.async_accept(
 				asio::make_strand(ioc_),
 				beast::bind_front_handler(
@@ -407,12 +1221,17 @@ namespace bserv {
 		}
 		void on_accept(beast::error_code ec, tcp::socket socket) {
 			if (ec) {
+				admission_->release_connection();
+				if (!acceptor_.is_open()) return;
 				fail(ec, "listener::acceptor async_accept");
 			}
 			else {
 				lgtrace << "listener accepts: " << get_address(socket);
-				std::make_shared<http_session>(
-					ioc_, std::move(socket), routes_, ws_routes_)->run();
+				// the memory of the closed sessions is reused
+				std::allocate_shared<http_session>(
+					pool_allocator<http_session>{},
+					ioc_, std::move(socket), routes_, ws_routes_, ws_limiter_, admission_,
+					registry_)->run();
 			}
 			do_accept();
 		}
@@ -421,11 +1240,17 @@ namespace bserv {
 			asio::io_context& ioc,
 			tcp::endpoint endpoint,
 			router& routes,
-			router& ws_routes)
+			router& ws_routes,
+			std::shared_ptr<websocket_limiter> ws_limiter,
+			std::shared_ptr<admission_controller> admission,
+			std::shared_ptr<connection_registry> registry)
 			: ioc_{ ioc },
 			acceptor_{ asio::make_strand(ioc) },
 			routes_{ routes },
-			ws_routes_{ ws_routes } {
+			ws_routes_{ ws_routes },
+			ws_limiter_{ ws_limiter },
+			admission_{ admission },
+			registry_{ registry } {
 			beast::error_code ec;
 			acceptor_.open(endpoint.protocol(), ec);
 			if (ec) {
@@ -455,12 +1280,32 @@ namespace bserv {
 			}
 		}
 		void run() {
+			admission_->set_resume(
+				[weak = weak_from_this()]() {
+					if (auto self = weak.lock()) {
+						lginfo << "listener resumed";
+						asio::post(
+							self->acceptor_.get_executor(),
+							beast::bind_front_handler(
+								&listener::do_accept,
+								self));
+					}
+				});
 			asio::dispatch(
 				acceptor_.get_executor(),
 				beast::bind_front_handler(
 					&listener::do_accept,
 					shared_from_this()));
 		}
+		// stops accepting, the new connections are refused
+		void stop() {
+			asio::dispatch(
+				acceptor_.get_executor(),
+				[self = shared_from_this()]() {
+					beast::error_code ec;
+					self->acceptor_.close(ec);
+				});
+		}
 	};
 
 
@@ -473,8 +1318,19 @@ namespace bserv {
 		if (config.get_db_conn_str() != "") {
 			// database connection
 			try {
+				db_pool_options options;
+				options.min_size = config.get_min_db_conn();
+				options.max_size = config.get_num_db_conn();
+				options.cache_size = config.get_db_cache_size();
+				options.health_check_interval = std::chrono::seconds{ config.get_db_health_check_interval() };
+				options.idle_timeout = std::chrono::seconds{ config.get_db_idle_timeout() };
 				db_conn_mgr_ = std::make_shared<
-					db_connection_manager>(config.get_db_conn_str(), config.get_num_db_conn());
+					db_connection_manager>(config.get_db_conn_str(), options);
+				for (const auto& conn_str : config.get_db_replica_conn_strs())
+					db_conn_mgr_->add_replica(conn_str);
+				// it connects on the first subscription
+				db_listener_ = std::make_shared<db_listener>(
+					ioc_, config.get_db_conn_str());
 			}
 			catch (const std::exception& e) {
 				lgfatal << "db connection initialization failed: " << e.what() << std::endl;
@@ -482,26 +1338,88 @@ namespace bserv {
 			}
 		}
 		session_mgr_ = std::make_shared<memory_session_manager>();
+		ws_limiter_ = std::make_shared<websocket_limiter>(
+			config.get_max_websocket_sessions(),
+			config.get_max_websocket_sessions_per_ip(),
+			std::chrono::seconds{ config.get_websocket_ping_interval() },
+			std::chrono::seconds{ config.get_websocket_idle_timeout() });
+		admission_ = std::make_shared<admission_controller>(
+			config.get_max_connections(),
+			config.get_min_requests(),
+			config.get_max_requests(),
+			std::chrono::milliseconds{ config.get_admission_target_latency() });
 
 		std::shared_ptr<server_resources> resources_ptr = std::make_shared<server_resources>();
 		resources_ptr->session_mgr = session_mgr_;
 		resources_ptr->db_conn_mgr = db_conn_mgr_;
+		resources_ptr->db_listener_ptr = db_listener_;
+		resources_ptr->websocket_limiter_ptr = ws_limiter_;
+		resources_ptr->admission_controller_ptr = admission_;
+		resources_ptr->compression_level = config.get_compression_level();
+		resources_ptr->compression_threshold = config.get_compression_threshold();
 
 		routes_.set_resources(resources_ptr);
 		ws_routes_.set_resources(resources_ptr);
 
+		auto registry = std::make_shared<connection_registry>();
+
 		// creates and launches a listening port
-		std::make_shared<listener>(
-			ioc_, tcp::endpoint{ tcp::v4(), config.get_port() }, routes_, ws_routes_)->run();
+		auto listener_ptr = std::make_shared<listener>(
+			ioc_, tcp::endpoint{ tcp::v4(), config.get_port() },
+			routes_, ws_routes_, ws_limiter_, admission_, registry);
+		listener_ptr->run();
 
-		// captures SIGINT and SIGTERM to perform a clean shutdown
+		// captures SIGINT and SIGTERM to perform a graceful shutdown:
+		// the listener stops accepting, the requests being handled are
+		// answered with `Connection: close`, the idle connections are
+		// closed, and the websocket sessions are sent a close frame.
+		// the server stops when all of them are closed or the timeout
+		// expires, or on a second signal. the LISTEN connection of
+		// `db_listener` is closed right away.
 		asio::signal_set signals{ ioc_, SIGINT, SIGTERM };
+		asio::steady_timer drain_timer{ ioc_ };
+		const std::chrono::seconds shutdown_timeout{ config.get_shutdown_timeout() };
+		auto deadline = std::chrono::steady_clock::now();
+		std::function<void(const boost::system::error_code&)> wait_drained =
+			[&](const boost::system::error_code& ec) {
+				if (ec) return;
+				std::size_t connections = admission_->stats().connections;
+				std::size_t ws_sessions = ws_limiter_->stats().sessions;
+				if (connections == 0 && ws_sessions == 0) {
+					lginfo << "all connections are closed";
+					ioc_.stop();
+					return;
+				}
+				if (std::chrono::steady_clock::now() >= deadline) {
+					lgwarning << "shutdown timeout expired with " << connections
+						<< " connection(s) and " << ws_sessions << " websocket session(s)";
+					ioc_.stop();
+					return;
+				}
+				drain_timer.expires_after(std::chrono::milliseconds(SHUTDOWN_POLL_INTERVAL));
+				drain_timer.async_wait(wait_drained);
+			};
 		signals.async_wait(
-			[&](const boost::system::error_code&, int) {
-				// stops the `io_context`. This will cause `run()`
-				// to return immediately, eventually destroying the
-				// `io_context` and all of the sockets in it.
-				ioc_.stop();
+			[&](const boost::system::error_code& ec, int) {
+				if (ec) return;
+				deadline = std::chrono::steady_clock::now() + shutdown_timeout;
+				if (shutdown_timeout.count() == 0) {
+					ioc_.stop();
+					return;
+				}
+				lginfo << "shutting down " << config.get_name();
+				signals.async_wait(
+					[&](const boost::system::error_code& ec, int) {
+						if (ec) return;
+						lgwarning << "shutting down immediately";
+						ioc_.stop();
+					});
+				listener_ptr->stop();
+				registry->drain();
+				// closes the LISTEN connection, the websocket sessions
+				// subscribed to it are closed by `drain`
+				if (db_listener_ != nullptr) db_listener_->stop();
+				wait_drained({});
 			});
 
 		lginfo << config.get_name() << " started";
@@ -518,6 +1436,14 @@ namespace bserv {
 
 		// blocks until all the threads exit
 		for (auto& t : v) t.join();
+
+		// the connections of the database are returned by the requests
+		// before the timeout (or abandoned after it), and closed
+		if (db_conn_mgr_ != nullptr) {
+			auto now = std::chrono::steady_clock::now();
+			db_conn_mgr_->close(deadline > now
+				? deadline - now : std::chrono::steady_clock::duration::zero());
+		}
 	}
 
 }  // bserv
@@ -1,36 +1,505 @@
 #include "pch.h"
 #include "bserv/database.hpp"
+#include "bserv/logging.hpp"
+
+#include <algorithm>
 
 namespace bserv {
 
+    namespace {
+
+        // an estimation of the memory used by `result`
+        std::size_t get_result_bytes(
+            const std::string& query, const db_result& result) {
+            std::size_t bytes = query.size() + result.query().size();
+            for (const auto& row : result)
+                for (std::size_t i = 0; i < row.size(); ++i)
+                    bytes += row[i].size() + sizeof(std::size_t);
+            return bytes;
+        }
+
+        const std::string hex_digits = "0123456789abcdef";
+
+        // a cursor is the hex encoding of the direction ('a' for after,
+        // 'b' for before) followed by the serialized key.
+        std::string encode_cursor(char direction, const boost::json::value& key) {
+            std::string data = direction + boost::json::serialize(key);
+            std::string cursor;
+            for (unsigned char c : data) {
+                cursor += hex_digits[c >> 4];
+                cursor += hex_digits[c & 0xf];
+            }
+            return cursor;
+        }
+
+        boost::json::value decode_cursor(char direction, const std::string& cursor) {
+            if (cursor.size() % 2 != 0)
+                throw invalid_cursor_exception{};
+            std::string data;
+            for (std::size_t i = 0; i < cursor.size(); i += 2) {
+                auto high = hex_digits.find(cursor[i]);
+                auto low = hex_digits.find(cursor[i + 1]);
+                if (high == std::string::npos || low == std::string::npos)
+                    throw invalid_cursor_exception{};
+                data += (char)(high << 4 | low);
+            }
+            if (data.empty() || data[0] != direction)
+                throw invalid_cursor_exception{};
+            boost::json::error_code ec;
+            boost::json::value key = boost::json::parse(data.substr(1), ec);
+            if (ec || !(key.is_int64() || key.is_uint64() || key.is_string()))
+                throw invalid_cursor_exception{};
+            return key;
+        }
+
+    }  // namespace
+
+    void db_result_cache::erase(
+        std::map<std::string, entry>::iterator iterator) {
+        for (const auto& table : iterator->second.tables) {
+            auto p = tables_.find(table);
+            if (p == tables_.end()) continue;
+            p->second.erase(iterator->first);
+            if (p->second.empty()) tables_.erase(p);
+        }
+        lru_.erase(iterator->second.lru);
+        size_ -= iterator->second.bytes;
+        entries_.erase(iterator);
+    }
+
+    bool db_result_cache::try_get(
+        const std::string& query, db_result& result) {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        auto iterator = entries_.find(query);
+        if (iterator == entries_.end()) return false;
+        if (iterator->second.expiry < std::chrono::steady_clock::now()) {
+            erase(iterator);
+            return false;
+        }
+        // marks it as the most recently used
+        lru_.splice(lru_.begin(), lru_, iterator->second.lru);
+        result = iterator->second.result;
+        return true;
+    }
+
+    std::uint64_t db_result_cache::epoch() const {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        return epoch_;
+    }
+
+    void db_result_cache::put(
+        const std::string& query, const db_result& result,
+        std::chrono::milliseconds ttl,
+        const std::vector<std::string>& tables,
+        std::uint64_t epoch) {
+        std::size_t bytes = get_result_bytes(query, result);
+        // it would evict everything else
+        if (bytes > capacity_) return;
+        std::lock_guard<std::mutex> lg{ lock_ };
+        // a write has been committed since the query was executed
+        if (epoch != epoch_) return;
+        auto iterator = entries_.find(query);
+        if (iterator != entries_.end()) erase(iterator);
+        // evicts the least recently used entries
+        while (size_ + bytes > capacity_)
+            erase(entries_.find(lru_.back()));
+        lru_.push_front(query);
+        entries_.emplace(query, entry{
+            result,
+            std::chrono::steady_clock::now() + ttl,
+            bytes,
+            tables,
+            lru_.begin() });
+        size_ += bytes;
+        for (const auto& table : tables)
+            tables_[table].insert(query);
+    }
+
+    void db_result_cache::invalidate(const std::string& table) {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        ++epoch_;
+        auto p = tables_.find(table);
+        if (p == tables_.end()) return;
+        // `erase` modifies `tables_[table]`, so the queries are copied
+        std::set<std::string> queries = p->second;
+        for (const auto& query : queries) {
+            auto iterator = entries_.find(query);
+            if (iterator != entries_.end()) erase(iterator);
+        }
+    }
+
+    std::size_t db_result_cache::size() const {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        return size_;
+    }
+
+    std::shared_ptr<db_result_cache> db_connection::cache() const {
+        return mgr_.cache();
+    }
+
+    namespace {
+
+        // whether `conn` is open and answers a query
+        bool ping(raw_db_connection_type& conn) {
+            if (!conn.is_open()) return false;
+            try {
+                pqxx::nontransaction tx{ conn };
+                tx.exec("select 1;");
+                return true;
+            }
+            catch (const std::exception& e) {
+                lgwarning << "db connection health check failed: " << e.what() << std::endl;
+                return false;
+            }
+        }
+
+    }  // namespace
+
+    db_connection_manager::db_connection_manager(
+        const std::string& conn_str,
+        const db_pool_options& options)
+        : conn_str_{ conn_str },
+        min_size_{ (std::size_t)std::max(0, std::min(options.min_size, options.max_size)) },
+        max_size_{ (std::size_t)std::max(1, options.max_size) },
+        health_check_interval_{ options.health_check_interval },
+        idle_timeout_{ options.idle_timeout },
+        validate_after_{ options.validate_after },
+        size_{ 0 }, in_use_{ 0 }, waiters_{ 0 },
+        reconnects_{ 0 }, failed_reconnects_{ 0 },
+        backoff_{ DB_MIN_RECONNECT_BACKOFF },
+        is_replica_{ false },
+        stopped_{ false } {
+        // the exception is propagated if the database is unreachable
+        for (std::size_t i = 0; i < min_size_; ++i) {
+            idle_.push_back({
+                std::make_shared<raw_db_connection_type>(conn_str_),
+                std::chrono::steady_clock::now() });
+            ++size_;
+        }
+        if (options.cache_size != 0)
+            cache_ = std::make_shared<db_result_cache>(options.cache_size);
+        health_checker_ = std::thread{ [this] {
+            std::unique_lock<std::mutex> lk{ lock_ };
+            while (!stopped_) {
+                stopping_.wait_for(lk, health_check_interval_);
+                if (stopped_) break;
+                lk.unlock();
+                check_health();
+                lk.lock();
+            }
+        } };
+    }
+
+    db_connection_manager::~db_connection_manager() {
+        {
+            std::lock_guard<std::mutex> lg{ lock_ };
+            stopped_ = true;
+        }
+        stopping_.notify_all();
+        health_checker_.join();
+    }
+
+    std::shared_ptr<raw_db_connection_type> db_connection_manager::connect(
+        bool reconnect) {
+        {
+            std::lock_guard<std::mutex> lg{ lock_ };
+            if (std::chrono::steady_clock::now() < retry_after_)
+                throw db_connection_unavailable{
+                    "db connection unavailable: waiting to reconnect" };
+        }
+        try {
+            auto conn = std::make_shared<raw_db_connection_type>(conn_str_);
+            std::lock_guard<std::mutex> lg{ lock_ };
+            if (reconnect) ++reconnects_;
+            backoff_ = std::chrono::milliseconds{ DB_MIN_RECONNECT_BACKOFF };
+            return conn;
+        }
+        catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lg{ lock_ };
+            ++failed_reconnects_;
+            retry_after_ = std::chrono::steady_clock::now() + backoff_;
+            backoff_ = std::min(backoff_ * 2,
+                std::chrono::milliseconds{ DB_MAX_RECONNECT_BACKOFF });
+            lgerror << "db connection failed: " << e.what() << std::endl;
+            throw db_connection_unavailable{
+                std::string{ "db connection unavailable: " } + e.what() };
+        }
+    }
+
     std::shared_ptr<db_connection> db_connection_manager::get_or_block() {
-        // `counter_lock_` must be acquired first.
-        // exchanging this statement with the next will cause dead-lock,
-        // because if the request is blocked by `counter_lock_`,
-        // the destructor of `db_connection` will not be able to put
-        // itself back due to the `queue_lock_` has already been acquired
-        // by this request!
-        counter_lock_.lock();
-        // `queue_lock_` is acquired so that only one thread will
-        // modify the `queue_`
-        std::lock_guard<std::mutex> lg{ queue_lock_ };
-        std::shared_ptr<raw_db_connection_type> conn = queue_.front();
-        queue_.pop();
-        // if there are no connections in the `queue_`,
-        // `counter_lock_` remains to be locked
-        // so that the following requests will be blocked
-        if (queue_.size() != 0) counter_lock_.unlock();
+        std::shared_ptr<raw_db_connection_type> conn;
+        bool validate = false;
+        std::unique_lock<std::mutex> lk{ lock_ };
+        while (true) {
+            if (!idle_.empty()) {
+                // the most recently used one is preferred so that
+                // the others can be closed after being idle for long
+                conn = idle_.back().conn;
+                validate = idle_.back().since + validate_after_
+                    <= std::chrono::steady_clock::now();
+                idle_.pop_back();
+                break;
+            }
+            if (size_ < max_size_) {
+                // reserves a slot, the connection is opened
+                // after the lock is released
+                ++size_;
+                break;
+            }
+            ++waiters_;
+            available_.wait(lk);
+            --waiters_;
+        }
+        ++in_use_;
+        lk.unlock();
+        // `is_open` does not notice that the server has gone away
+        if (conn == nullptr || !(validate ? ping(*conn) : conn->is_open())) {
+            try {
+                conn = connect(conn != nullptr);
+            }
+            catch (...) {
+                // releases the slot
+                lk.lock();
+                --size_;
+                --in_use_;
+                lk.unlock();
+                available_.notify_one();
+                throw;
+            }
+        }
         return std::make_shared<db_connection>(*this, conn);
     }
 
+    void db_connection_manager::put_back(
+        std::shared_ptr<raw_db_connection_type> conn) {
+        std::deque<idle_connection> closing;
+        {
+            std::lock_guard<std::mutex> lg{ lock_ };
+            --in_use_;
+            if (is_replica_ && !conn->is_open()) {
+                // the replica is probably down, so the other connections
+                // are not handed out until the backoff expires
+                auto now = std::chrono::steady_clock::now();
+                if (retry_after_ <= now) {
+                    lgwarning << "db replica marked down" << std::endl;
+                    retry_after_ = now + backoff_;
+                    backoff_ = std::min(backoff_ * 2,
+                        std::chrono::milliseconds{ DB_MAX_RECONNECT_BACKOFF });
+                }
+                closing.swap(idle_);
+                size_ -= closing.size() + 1;
+            }
+            else {
+                // a connection broken on the primary is also put back,
+                // and will be reopened on checkout.
+                idle_.push_back({ conn, std::chrono::steady_clock::now() });
+            }
+        }
+        // the connections are closed without holding the lock
+        closing.clear();
+        available_.notify_one();
+    }
+
+    void db_connection_manager::close(std::chrono::steady_clock::duration timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::deque<idle_connection> closing;
+        {
+            std::unique_lock<std::mutex> lk{ lock_ };
+            // `put_back` notifies one of the waiters only,
+            // so it is checked periodically
+            while (in_use_ != 0 && std::chrono::steady_clock::now() < deadline)
+                available_.wait_until(lk, (std::min)(deadline,
+                    std::chrono::steady_clock::now() + std::chrono::milliseconds{ 10 }));
+            if (in_use_ != 0)
+                lgwarning << "db connection manager: closing with "
+                << in_use_ << " connection(s) in use" << std::endl;
+            closing.swap(idle_);
+            size_ -= closing.size();
+        }
+        // the connections are closed outside the lock
+        closing.clear();
+        for (auto& replica : replicas_)
+            replica->close(deadline - std::chrono::steady_clock::now());
+    }
+
+    void db_connection_manager::check_health() {
+        std::vector<idle_connection> checking;
+        std::vector<std::shared_ptr<raw_db_connection_type>> closing;
+        time_point now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lg{ lock_ };
+            // the oldest connections are at the front
+            while (!idle_.empty()
+                && idle_.front().since + health_check_interval_ <= now) {
+                if (size_ > min_size_
+                    && idle_.front().since + idle_timeout_ <= now) {
+                    // shrinks the pool
+                    closing.push_back(idle_.front().conn);
+                    --size_;
+                }
+                else {
+                    checking.push_back(idle_.front());
+                }
+                idle_.pop_front();
+            }
+        }
+        // the connections are closed without holding the lock
+        closing.clear();
+        for (auto& idle : checking) {
+            if (!ping(*idle.conn)) {
+                try {
+                    idle.conn = connect(true);
+                }
+                catch (const std::exception&) {
+                    // keeps the broken one,
+                    // it will be reopened on checkout
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lg{ lock_ };
+            // they are older than the others
+            for (auto p = checking.rbegin(); p != checking.rend(); ++p)
+                idle_.push_front(*p);
+        }
+        if (!checking.empty()) available_.notify_all();
+    }
+
+    void db_connection_manager::add_replica(const std::string& conn_str) {
+        const auto replica_options = [this](int min_size) {
+            db_pool_options options;
+            options.min_size = min_size;
+            options.max_size = (int)max_size_;
+            options.health_check_interval = health_check_interval_;
+            options.idle_timeout = idle_timeout_;
+            options.validate_after = validate_after_;
+            return options;
+        };
+        std::shared_ptr<db_connection_manager> replica;
+        try {
+            replica = std::make_shared<db_connection_manager>(
+                conn_str, replica_options((int)min_size_));
+        }
+        catch (const std::exception& e) {
+            // the replica is still added, its connections will be
+            // opened on demand once it is reachable.
+            lgerror << "db replica connection failed: " << e.what() << std::endl;
+            replica = std::make_shared<db_connection_manager>(
+                conn_str, replica_options(0));
+        }
+        replica->is_replica_ = true;
+        replicas_.emplace_back(replica);
+    }
+
+    std::shared_ptr<db_connection> db_connection_manager::get_read_or_block() {
+        std::vector<std::pair<std::size_t, db_connection_manager*>> candidates;
+        for (auto& replica : replicas_)
+            if (replica->available())
+                candidates.emplace_back(replica->load(), replica.get());
+        std::stable_sort(candidates.begin(), candidates.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (auto& candidate : candidates) {
+            try {
+                return candidate.second->get_or_block();
+            }
+            catch (const db_connection_unavailable& e) {
+                lgwarning << "db replica skipped: " << e.what() << std::endl;
+            }
+        }
+        return get_or_block();
+    }
+
+    bool db_connection_manager::available() const {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        return retry_after_ <= std::chrono::steady_clock::now();
+    }
+
+    std::size_t db_connection_manager::load() const {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        return in_use_ + waiters_;
+    }
+
+    db_pool_stats db_connection_manager::stats() const {
+        std::lock_guard<std::mutex> lg{ lock_ };
+        return {
+            size_,
+            in_use_,
+            idle_.size(),
+            waiters_,
+            reconnects_,
+            failed_reconnects_
+        };
+    }
+
+    db_page db_keyset_paginator::fetch(
+        db_transaction& tx,
+        const std::string& after,
+        const std::string& before) {
+        // one more row is fetched to see if there is a further page
+        std::size_t limit = page_size_ + 1;
+        bool backward = after.empty() && !before.empty();
+        db_result result;
+        if (!after.empty()) {
+            result = tx.exec(
+                "select * from ? where ? > ? order by ? asc limit ?;",
+                db_name(table_), db_name(key_),
+                decode_cursor('a', after), db_name(key_), limit);
+        }
+        else if (backward) {
+            result = tx.exec(
+                "select * from ? where ? < ? order by ? desc limit ?;",
+                db_name(table_), db_name(key_),
+                decode_cursor('b', before), db_name(key_), limit);
+        }
+        else {
+            result = tx.exec(
+                "select * from ? order by ? asc limit ?;",
+                db_name(table_), db_name(key_), limit);
+        }
+        db_page page;
+        page.items = orm_.convert_to_vector(result);
+        bool more = page.items.size() > page_size_;
+        if (more) page.items.pop_back();
+        if (backward) std::reverse(page.items.begin(), page.items.end());
+        if (page.items.empty()) return page;
+        // the page reached by a cursor always has a neighbour
+        // in the opposite direction
+        if (backward) {
+            page.next = encode_cursor('a', page.items.back().at(key_));
+            if (more)
+                page.previous = encode_cursor('b', page.items.front().at(key_));
+        }
+        else {
+            if (more)
+                page.next = encode_cursor('a', page.items.back().at(key_));
+            if (!after.empty())
+                page.previous = encode_cursor('b', page.items.front().at(key_));
+        }
+        return page;
+    }
+
+    std::optional<std::size_t> db_keyset_paginator::approximate_count(
+        db_transaction& tx) {
+        db_result result = tx.exec(
+            "select reltuples::bigint from pg_class where oid = quote_ident(?)::regclass;",
+            table_);
+        if (result.begin() == result.end()) return std::nullopt;
+        // it is -1 if the table has never been vacuumed or analyzed
+        auto count = (*result.begin())[0].as<std::int64_t>();
+        if (count < 0) return std::nullopt;
+        return (std::size_t)count;
+    }
+
+    std::size_t db_keyset_paginator::count(
+        db_transaction& tx, std::chrono::milliseconds ttl) {
+        db_result result = tx.exec_cached(
+            ttl, { table_ },
+            "select count(*) from ?;", db_name(table_));
+        return (*result.begin())[0].as<std::size_t>();
+    }
+
     db_connection::~db_connection() {
-        std::lock_guard<std::mutex> lg{ mgr_.queue_lock_ };
-        mgr_.queue_.emplace(conn_);
-        // if this is the first available connection back to the queue,
-        // `counter_lock_` is unlocked so that the blocked requests will
-        // be notified
-        if (mgr_.queue_.size() == 1)
-            mgr_.counter_lock_.unlock();
+        mgr_.put_back(conn_);
     }
 
 }  // bserv
\ No newline at end of file
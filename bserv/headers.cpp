@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "bserv/headers.hpp"
+#include "bserv/config.hpp"
+
+#include <ctime>
+#include <cstring>
+
+namespace bserv {
+
+    namespace {
+
+        const char* const DAY_NAMES[] = {
+            "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+        };
+        const char* const MONTH_NAMES[] = {
+            "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+        };
+
+        void format_two_digits(char* p, int n) {
+            p[0] = static_cast<char>('0' + n / 10);
+            p[1] = static_cast<char>('0' + n % 10);
+        }
+
+        // writes `HTTP_DATE_SIZE` bytes
+        void format_http_date(std::time_t t, char* p) {
+            std::tm tm;
+#ifdef _MSC_VER
+            gmtime_s(&tm, &t);
+#else
+            gmtime_r(&t, &tm);
+#endif
+            std::memcpy(p, DAY_NAMES[tm.tm_wday], 3);
+            std::memcpy(p + 3, ", ", 2);
+            format_two_digits(p + 5, tm.tm_mday);
+            p[7] = ' ';
+            std::memcpy(p + 8, MONTH_NAMES[tm.tm_mon], 3);
+            p[11] = ' ';
+            int year = tm.tm_year + 1900;
+            format_two_digits(p + 12, year / 100);
+            format_two_digits(p + 14, year % 100);
+            p[16] = ' ';
+            format_two_digits(p + 17, tm.tm_hour);
+            p[19] = ':';
+            format_two_digits(p + 20, tm.tm_min);
+            p[22] = ':';
+            format_two_digits(p + 23, tm.tm_sec);
+            std::memcpy(p + 25, " GMT", 4);
+        }
+
+        const char CRLF[] = "\r\n\r\n";
+
+    }  // namespace
+
+    beast::string_view http_date() {
+        // each thread has its own copy, so no lock is needed
+        thread_local std::time_t cached_time = -1;
+        thread_local char cached_date[HTTP_DATE_SIZE];
+        std::time_t now = std::time(nullptr);
+        if (now != cached_time) {
+            format_http_date(now, cached_date);
+            cached_time = now;
+        }
+        return { cached_date, HTTP_DATE_SIZE };
+    }
+
+    prebuilt_response::prebuilt_response(
+        http::status status,
+        std::string body,
+        std::initializer_list<std::pair<http::field, std::string>> fields,
+        const std::string& content_type)
+        : status_{ status }, body_{ std::move(body) } {
+        std::string common;
+        common += "Server: " + NAME + "\r\n";
+        common += "Content-Type: " + content_type + "\r\n";
+        for (auto& [field, value] : fields) {
+            common += std::string{ http::to_string(field) } + ": " + value + "\r\n";
+        }
+        common += "Content-Length: " + std::to_string(body_.size()) + "\r\n";
+        for (int v = 0; v < 2; ++v) {
+            for (int keep_alive = 0; keep_alive < 2; ++keep_alive) {
+                std::string& head = heads_[v][keep_alive];
+                head = v == 1 ? "HTTP/1.1 " : "HTTP/1.0 ";
+                head += std::to_string(static_cast<unsigned>(status_)) + " ";
+                head += std::string{ http::obsolete_reason(status_) } + "\r\n";
+                head += common;
+                // the defaults of each version are not written
+                if (v == 1 && !keep_alive) head += "Connection: close\r\n";
+                if (v == 0 && keep_alive) head += "Connection: keep-alive\r\n";
+                head += "Date: ";
+            }
+        }
+    }
+
+    prebuilt_response::buffers_type prebuilt_response::buffers(
+        unsigned version, bool keep_alive, const char* date) const {
+        const std::string& head = heads_[version >= 11][keep_alive];
+        return {
+            asio::const_buffer{ head.data(), head.size() },
+            asio::const_buffer{ date, HTTP_DATE_SIZE },
+            // ends the `Date` and the header
+            asio::const_buffer{ CRLF, 4 },
+            asio::const_buffer{ body_.data(), body_.size() }
+        };
+    }
+
+}  // bserv
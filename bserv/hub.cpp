@@ -0,0 +1,91 @@
+#include "pch.h"
+#include "bserv/hub.hpp"
+
+#include <vector>
+#include <mutex>
+
+namespace bserv {
+
+    websocket_subscription::~websocket_subscription() {
+        if (auto hub = hub_.lock()) hub->unsubscribe(topic_, id_);
+    }
+
+    websocket_subscription websocket_hub::subscribe(
+        const std::string& topic,
+        std::shared_ptr<websocket_session> session) {
+        std::size_t id = next_id_++;
+        std::lock_guard<std::shared_mutex> lg{ lock_ };
+        topics_[topic][id] = session;
+        return { weak_from_this(), topic, id };
+    }
+
+    void websocket_hub::unsubscribe(const std::string& topic, std::size_t id) {
+        std::lock_guard<std::shared_mutex> lg{ lock_ };
+        auto it = topics_.find(topic);
+        if (it == topics_.end()) return;
+        it->second.erase(id);
+        if (it->second.empty()) topics_.erase(it);
+    }
+
+    std::size_t websocket_hub::publish(
+        const std::string& topic, const boost::json::value& message) {
+        return publish(topic,
+            std::make_shared<const std::string>(boost::json::serialize(message)));
+    }
+
+    std::size_t websocket_hub::publish(
+        const std::string& topic,
+        std::shared_ptr<const std::string> message, bool binary) {
+        ++published_;
+        std::size_t delivered = 0;
+        // the sessions that are closed or disconnected
+        std::vector<std::size_t> removed;
+        {
+            std::shared_lock<std::shared_mutex> lk{ lock_ };
+            auto it = topics_.find(topic);
+            if (it == topics_.end()) return 0;
+            for (const auto& [id, weak_session] : it->second) {
+                auto session = weak_session.lock();
+                if (session == nullptr || session->closed()) {
+                    removed.emplace_back(id);
+                }
+                else if (session->queue_size() >= max_queue_size_
+                    || !session->writable()) {
+                    if (policy_ == slow_consumer_policy::drop) {
+                        ++dropped_;
+                    }
+                    else {
+                        session->close(websocket::close_code::try_again_later);
+                        ++disconnected_;
+                        removed.emplace_back(id);
+                    }
+                }
+                else {
+                    session->send(message, binary);
+                    ++delivered;
+                }
+            }
+        }
+        if (!removed.empty()) {
+            std::lock_guard<std::shared_mutex> lg{ lock_ };
+            auto it = topics_.find(topic);
+            if (it != topics_.end()) {
+                for (auto id : removed) it->second.erase(id);
+                if (it->second.empty()) topics_.erase(it);
+            }
+        }
+        return delivered;
+    }
+
+    websocket_hub_stats websocket_hub::stats() const {
+        std::shared_lock<std::shared_mutex> lk{ lock_ };
+        std::size_t sessions = 0;
+        for (const auto& [topic, subscribers] : topics_)
+            sessions += subscribers.size();
+        return {
+            topics_.size(), sessions,
+            published_.load(), dropped_.load(), disconnected_.load()
+        };
+    }
+
+}  // bserv
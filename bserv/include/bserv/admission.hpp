@@ -0,0 +1,84 @@
+#ifndef _ADMISSION_HPP
+#define _ADMISSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <functional>
+
+#include "config.hpp"
+
+namespace bserv {
+
+	struct admission_stats {
+		// the number of open http connections
+		std::size_t connections;
+		// the number of requests being handled
+		std::size_t requests;
+		// the current limit of the requests being handled
+		std::size_t request_limit;
+		// the number of times the listener paused accepting
+		std::size_t paused;
+		// the number of requests answered with 503
+		std::size_t rejected;
+		// the smoothed latency of the requests
+		std::chrono::microseconds latency;
+	};
+
+	// the admission control of the http server:
+	// - at most `max_connections` connections are open, the listener
+	//   stops accepting at the cap (the new connections wait in the
+	//   backlog) and resumes when a connection is closed;
+	// - the requests being handled are limited, and the requests beyond
+	//   the limit are answered with a prebuilt `503` with `Retry-After`.
+	//   if `target_latency` is not zero, the limit adapts to the observed
+	//   latency in [min_requests, max_requests] (AIMD): it grows by one
+	//   for each `limit` requests handled within `target_latency`, and
+	//   it is multiplied by `ADMISSION_DECREASE_FACTOR` (at most once per
+	//   `target_latency`) when a request takes longer, so that the queues
+	//   stay short when the handlers slow down.
+	class admission_controller {
+	private:
+		const std::size_t max_connections_;
+		const std::size_t min_requests_;
+		const std::size_t max_requests_;
+		const std::chrono::steady_clock::duration target_latency_;
+		mutable std::mutex lock_;
+		std::size_t connections_;
+		std::size_t requests_;
+		double limit_;
+		bool paused_;
+		std::function<void()> resume_;
+		std::chrono::steady_clock::time_point last_decrease_;
+		std::chrono::steady_clock::duration latency_;
+		std::size_t paused_count_;
+		std::size_t rejected_;
+	public:
+		admission_controller(
+			std::size_t max_connections = MAX_CONNECTIONS,
+			std::size_t min_requests = MIN_REQUESTS,
+			std::size_t max_requests = MAX_REQUESTS,
+			std::chrono::milliseconds target_latency = std::chrono::milliseconds{ ADMISSION_TARGET_LATENCY });
+		admission_controller(const admission_controller&) = delete;
+		admission_controller& operator=(const admission_controller&) = delete;
+		// `resume` is called (without the lock) when a connection is
+		// closed after `try_acquire_connection` returned false.
+		void set_resume(std::function<void()> resume);
+		// returns false at the cap, otherwise
+		// `release_connection` should be called when it is closed.
+		bool try_acquire_connection();
+		void release_connection();
+		// returns false beyond the limit, otherwise
+		// `release_request` should be called when it is handled.
+		bool try_acquire_request();
+		// `latency` adjusts the limit,
+		// `std::nullopt` for the requests not to be measured (e.g. streaming).
+		void release_request(std::optional<std::chrono::steady_clock::duration> latency);
+		admission_stats stats() const;
+	};
+
+}  // bserv
+
+#endif  // _ADMISSION_HPP
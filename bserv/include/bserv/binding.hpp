@@ -0,0 +1,523 @@
+#ifndef _BINDING_HPP
+#define _BINDING_HPP
+
+#include <boost/json.hpp>
+#include <boost/json/basic_parser_impl.hpp>
+#include <boost/core/ignore_unused.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/punctuation/comma_if.hpp>
+#include <boost/preprocessor/seq/for_each_i.hpp>
+#include <boost/preprocessor/stringize.hpp>
+#include <boost/preprocessor/variadic/to_seq.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <charconv>
+#include <type_traits>
+#include <utility>
+
+#include "client.hpp"
+#include "params.hpp"
+#include "stream.hpp"
+
+namespace bserv {
+
+	// a member of `T` bound to the parameter `name`
+	template <typename T, typename M>
+	struct params_field {
+		const char* name;
+		M T::* member;
+	};
+
+	template <typename T, typename M>
+	constexpr params_field<T, M> make_params_field(const char* name, M T::* member) {
+		return { name, member };
+	}
+
+	template <typename T>
+	struct bind_result {
+		T value;
+		// e.g. "`username` is required"
+		std::vector<std::string> errors;
+		bool ok() const { return errors.empty(); }
+		std::string message() const {
+			std::string msg;
+			for (auto& error : errors) {
+				if (!msg.empty()) msg += "; ";
+				msg += error;
+			}
+			return msg;
+		}
+	};
+
+#define BSERV_PARAMS_FIELD_(r, type, i, field) \
+	BOOST_PP_COMMA_IF(i) ::bserv::make_params_field(BOOST_PP_STRINGIZE(field), &type::field)
+
+	// declares the members of `type` bound to the parameters of the same
+	// names by `bind_params` (or `placeholders::params_as<type>`).
+	// it should be used in the namespace of `type`.
+	// the supported member types are `std::string`, integers, floating
+	// point numbers, `bool`, `boost::json::value` and `std::optional` of
+	// them. the members other than `std::optional` are required.
+	// Usage:
+	//   struct register_request {
+	//       std::string username;
+	//       std::optional<std::string> email;
+	//   };
+	//   BSERV_PARAMS_FIELDS(register_request, username, email)
+#define BSERV_PARAMS_FIELDS(type, ...) \
+	inline auto bserv_params_fields(const type*) { \
+		return ::std::make_tuple(BOOST_PP_SEQ_FOR_EACH_I( \
+			BSERV_PARAMS_FIELD_, type, BOOST_PP_VARIADIC_TO_SEQ(__VA_ARGS__))); \
+	}
+
+	namespace binding_internal {
+
+		template <typename T>
+		const auto& fields_of() {
+			// found by argument-dependent lookup
+			static const auto fields = bserv_params_fields(static_cast<const T*>(nullptr));
+			return fields;
+		}
+
+		template <typename M>
+		struct field_traits {
+			static constexpr bool optional = false;
+			using value_type = M;
+		};
+
+		template <typename U>
+		struct field_traits<std::optional<U>> {
+			static constexpr bool optional = true;
+			using value_type = U;
+		};
+
+		template <typename M>
+		using value_type_t = typename field_traits<M>::value_type;
+
+		template <typename V>
+		const char* kind_name() {
+			if constexpr (std::is_same_v<V, bool>) return "a boolean";
+			else if constexpr (std::is_integral_v<V>) return "an integer";
+			else if constexpr (std::is_floating_point_v<V>) return "a number";
+			else if constexpr (std::is_same_v<V, std::string>) return "a string";
+			else return "a json value";
+		}
+
+		template <typename M>
+		value_type_t<M>& target(M& m) {
+			if constexpr (field_traits<M>::optional) {
+				if (!m.has_value()) m.emplace();
+				return m.value();
+			}
+			else return m;
+		}
+
+		// the setters return false if the type does not match.
+
+		// `parse` is true for the parameters of a form or the query
+		// string, which are strings whatever the type is.
+		template <typename M>
+		bool set_string(M& m, std::string_view s, bool parse) {
+			using V = value_type_t<M>;
+			if constexpr (std::is_same_v<V, std::string>) {
+				target(m).assign(s.data(), s.size());
+				return true;
+			}
+			else if constexpr (std::is_same_v<V, boost::json::value>) {
+				target(m) = boost::json::string_view{ s.data(), s.size() };
+				return true;
+			}
+			else if constexpr (std::is_same_v<V, bool>) {
+				if (!parse) return false;
+				if (s == "true" || s == "on" || s == "1") target(m) = true;
+				else if (s == "false" || s == "off" || s == "0") target(m) = false;
+				else return false;
+				return true;
+			}
+			else if constexpr (std::is_integral_v<V>) {
+				if (!parse) return false;
+				V v{};
+				auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+				if (ec != std::errc{} || p != s.data() + s.size()) return false;
+				target(m) = v;
+				return true;
+			}
+			else if constexpr (std::is_floating_point_v<V>) {
+				if (!parse || s.empty()) return false;
+				std::string copied{ s };
+				char* end = nullptr;
+				double d = std::strtod(copied.c_str(), &end);
+				if (*end != '\0') return false;
+				target(m) = static_cast<V>(d);
+				return true;
+			}
+			else return false;
+		}
+
+		template <typename M>
+		bool set_int64(M& m, std::int64_t i) {
+			using V = value_type_t<M>;
+			if constexpr (std::is_same_v<V, bool>) return false;
+			else if constexpr (std::is_integral_v<V> && std::is_signed_v<V>) {
+				if (i < static_cast<std::int64_t>((std::numeric_limits<V>::min)())
+					|| i > static_cast<std::int64_t>((std::numeric_limits<V>::max)())) return false;
+				target(m) = static_cast<V>(i);
+				return true;
+			}
+			else if constexpr (std::is_integral_v<V>) {
+				if (i < 0 || static_cast<std::uint64_t>(i) > (std::numeric_limits<V>::max)()) return false;
+				target(m) = static_cast<V>(i);
+				return true;
+			}
+			else if constexpr (std::is_floating_point_v<V>) {
+				target(m) = static_cast<V>(i);
+				return true;
+			}
+			else if constexpr (std::is_same_v<V, boost::json::value>) {
+				target(m) = i;
+				return true;
+			}
+			else return false;
+		}
+
+		template <typename M>
+		bool set_uint64(M& m, std::uint64_t u) {
+			using V = value_type_t<M>;
+			if constexpr (std::is_same_v<V, bool>) return false;
+			else if constexpr (std::is_integral_v<V>) {
+				if (u > static_cast<std::uint64_t>((std::numeric_limits<V>::max)())) return false;
+				target(m) = static_cast<V>(u);
+				return true;
+			}
+			else if constexpr (std::is_floating_point_v<V>) {
+				target(m) = static_cast<V>(u);
+				return true;
+			}
+			else if constexpr (std::is_same_v<V, boost::json::value>) {
+				target(m) = u;
+				return true;
+			}
+			else return false;
+		}
+
+		template <typename M>
+		bool set_double(M& m, double d) {
+			using V = value_type_t<M>;
+			if constexpr (std::is_floating_point_v<V>) {
+				target(m) = static_cast<V>(d);
+				return true;
+			}
+			else if constexpr (std::is_same_v<V, boost::json::value>) {
+				target(m) = d;
+				return true;
+			}
+			else return false;
+		}
+
+		template <typename M>
+		bool set_bool(M& m, bool b) {
+			using V = value_type_t<M>;
+			if constexpr (std::is_same_v<V, bool> || std::is_same_v<V, boost::json::value>) {
+				target(m) = b;
+				return true;
+			}
+			else return false;
+		}
+
+		template <typename M>
+		bool set_null(M& m) {
+			if constexpr (field_traits<M>::optional) {
+				m.reset();
+				return true;
+			}
+			else if constexpr (std::is_same_v<M, boost::json::value>) {
+				m = nullptr;
+				return true;
+			}
+			else return false;
+		}
+
+		template <typename M>
+		bool set_value(M& m, boost::json::value&& v) {
+			if constexpr (std::is_same_v<value_type_t<M>, boost::json::value>) {
+				target(m) = std::move(v);
+				return true;
+			}
+			else return false;
+		}
+
+		// a parameter of a form or the query string
+		template <typename M>
+		bool set_param(M& m, const boost::json::value& v) {
+			switch (v.kind()) {
+			case boost::json::kind::string:
+				return set_string(m, { v.get_string().data(), v.get_string().size() }, true);
+			case boost::json::kind::int64:
+				return set_int64(m, v.get_int64());
+			case boost::json::kind::uint64:
+				return set_uint64(m, v.get_uint64());
+			case boost::json::kind::double_:
+				return set_double(m, v.get_double());
+			case boost::json::kind::bool_:
+				return set_bool(m, v.get_bool());
+			case boost::json::kind::null:
+				return set_null(m);
+			default:
+				return set_value(m, boost::json::value{ v });
+			}
+		}
+
+		template <typename T, typename Fields, std::size_t ...I, typename Func>
+		void visit_field(const Fields& fields, std::size_t idx, std::index_sequence<I...>, Func&& f) {
+			boost::ignore_unused((... || (idx == I ? (f(std::get<I>(fields)), true) : false)));
+		}
+
+		template <typename Fields, std::size_t ...I>
+		int find_field(const Fields& fields, std::string_view name, std::index_sequence<I...>) {
+			int idx = -1;
+			boost::ignore_unused((... || (name == std::get<I>(fields).name ? (idx = static_cast<int>(I), true) : false)));
+			return idx;
+		}
+
+		// a SAX handler of `boost::json::basic_parser` which assigns
+		// the values of the top-level keys to the members of `T`
+		// directly, without building the object.
+		template <typename T>
+		class binding_handler {
+		private:
+			using fields_type = std::decay_t<decltype(fields_of<T>())>;
+			static constexpr std::size_t size = std::tuple_size_v<fields_type>;
+			using indices = std::make_index_sequence<size>;
+			T& value_;
+			std::vector<std::string>& errors_;
+			int depth_;
+			// the field of the value being parsed, -1 if it is not bound
+			int current_;
+			// the value of a `boost::json::value` member is being built
+			bool capturing_;
+			std::string key_;
+			std::string string_;
+			boost::json::value_stack st_;
+			template <typename Set>
+			bool set(Set&& s) {
+				if (depth_ != 1 || current_ < 0) return true;
+				visit_field<T>(fields_of<T>(), current_, indices{}, [&](const auto& field) {
+					using V = value_type_t<std::decay_t<decltype(value_.*(field.member))>>;
+					if (!s(value_.*(field.member)))
+						errors_.push_back(std::string{ "`" } + field.name + "` must be " + kind_name<V>());
+					});
+				current_ = -1;
+				return true;
+			}
+			// the top-level value is not an object
+			bool root(boost::json::error_code& ec) {
+				if (depth_ != 0) return true;
+				not_object = true;
+				ec = boost::system::errc::make_error_code(
+					boost::system::errc::operation_canceled);
+				return false;
+			}
+			// an object or an array is the value of the current field
+			void begin_nested() {
+				if (depth_ != 1 || current_ < 0) return;
+				bool capture = false;
+				visit_field<T>(fields_of<T>(), current_, indices{}, [&](const auto& field) {
+					using V = value_type_t<std::decay_t<decltype(value_.*(field.member))>>;
+					capture = std::is_same_v<V, boost::json::value>;
+					if (!capture)
+						errors_.push_back(std::string{ "`" } + field.name + "` must be " + kind_name<V>());
+					});
+				if (capture) {
+					capturing_ = true;
+					st_.reset();
+				}
+				else current_ = -1;
+			}
+			bool end_nested() {
+				if (depth_ != 1 || !capturing_) return true;
+				capturing_ = false;
+				boost::json::value v = st_.release();
+				return set([&v](auto& m) { return set_value(m, std::move(v)); });
+			}
+		public:
+			constexpr static std::size_t max_object_size = std::size_t(-1);
+			constexpr static std::size_t max_array_size = std::size_t(-1);
+			constexpr static std::size_t max_key_size = std::size_t(-1);
+			constexpr static std::size_t max_string_size = std::size_t(-1);
+
+			std::array<bool, size> seen{};
+			bool not_object = false;
+
+			binding_handler(T& value, std::vector<std::string>& errors)
+				: value_{ value }, errors_{ errors },
+				depth_{ 0 }, current_{ -1 }, capturing_{ false } {}
+
+			bool on_document_begin(boost::json::error_code&) { return true; }
+			bool on_document_end(boost::json::error_code&) { return true; }
+			bool on_object_begin(boost::json::error_code&) {
+				begin_nested();
+				++depth_;
+				return true;
+			}
+			bool on_object_end(std::size_t n, boost::json::error_code&) {
+				--depth_;
+				if (capturing_) st_.push_object(n);
+				return end_nested();
+			}
+			bool on_array_begin(boost::json::error_code& ec) {
+				if (!root(ec)) return false;
+				begin_nested();
+				++depth_;
+				return true;
+			}
+			bool on_array_end(std::size_t n, boost::json::error_code&) {
+				--depth_;
+				if (capturing_) st_.push_array(n);
+				return end_nested();
+			}
+			bool on_key_part(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+				if (capturing_) st_.push_chars(s);
+				else if (depth_ == 1) key_.append(s.data(), s.size());
+				return true;
+			}
+			bool on_key(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+				if (capturing_) {
+					st_.push_key(s);
+					return true;
+				}
+				if (depth_ != 1) return true;
+				key_.append(s.data(), s.size());
+				current_ = find_field(fields_of<T>(), key_, indices{});
+				if (current_ >= 0) seen[current_] = true;
+				key_.clear();
+				return true;
+			}
+			bool on_string_part(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+				if (capturing_) st_.push_chars(s);
+				else if (depth_ == 1 && current_ >= 0) string_.append(s.data(), s.size());
+				return true;
+			}
+			bool on_string(boost::json::string_view s, std::size_t, boost::json::error_code& ec) {
+				if (!root(ec)) return false;
+				if (capturing_) {
+					st_.push_string(s);
+					return true;
+				}
+				if (depth_ != 1 || current_ < 0) return true;
+				string_.append(s.data(), s.size());
+				set([this](auto& m) { return set_string(m, string_, false); });
+				string_.clear();
+				return true;
+			}
+			bool on_number_part(boost::json::string_view, boost::json::error_code&) { return true; }
+			bool on_int64(std::int64_t i, boost::json::string_view, boost::json::error_code& ec) {
+				if (!root(ec)) return false;
+				if (capturing_) st_.push_int64(i);
+				return set([i](auto& m) { return set_int64(m, i); });
+			}
+			bool on_uint64(std::uint64_t u, boost::json::string_view, boost::json::error_code& ec) {
+				if (!root(ec)) return false;
+				if (capturing_) st_.push_uint64(u);
+				return set([u](auto& m) { return set_uint64(m, u); });
+			}
+			bool on_double(double d, boost::json::string_view, boost::json::error_code& ec) {
+				if (!root(ec)) return false;
+				if (capturing_) st_.push_double(d);
+				return set([d](auto& m) { return set_double(m, d); });
+			}
+			bool on_bool(bool b, boost::json::error_code& ec) {
+				if (!root(ec)) return false;
+				if (capturing_) st_.push_bool(b);
+				return set([b](auto& m) { return set_bool(m, b); });
+			}
+			bool on_null(boost::json::error_code& ec) {
+				if (!root(ec)) return false;
+				if (capturing_) st_.push_null();
+				return set([](auto& m) { return set_null(m); });
+			}
+			bool on_comment_part(boost::json::string_view, boost::json::error_code&) { return true; }
+			bool on_comment(boost::json::string_view, boost::json::error_code&) { return true; }
+		};
+
+	}  // binding_internal
+
+	// binds the parameters of a request to the members of `T` declared by
+	// `BSERV_PARAMS_FIELDS`. a json body is parsed by a SAX handler, which
+	// assigns the values to the members as they are parsed (no
+	// `boost::json::object` is built), and the parameters of a form or the
+	// query string are converted from strings.
+	// the body is read from `body_reader` on a streaming route.
+	template <typename T>
+	bind_result<T> bind_params(
+		const request_type& request,
+		request_body_reader* body_reader = nullptr) {
+		using namespace binding_internal;
+		const auto& fields = fields_of<T>();
+		constexpr std::size_t size = std::tuple_size_v<std::decay_t<decltype(fields)>>;
+		bind_result<T> result{};
+		std::array<bool, size> seen{};
+		request_params params{ request, body_reader };
+		if (params.is_json()) {
+			boost::json::basic_parser<binding_handler<T>> parser{
+				boost::json::parse_options{}, result.value, result.errors };
+			boost::json::error_code ec;
+			if (body_reader != nullptr) {
+				// the body is parsed as it is read
+				const std::size_t buffer_size = 64 * 1024;
+				auto buffer = std::make_unique<char[]>(buffer_size);
+				while (!ec) {
+					std::size_t n = body_reader->read_some(buffer.get(), buffer_size);
+					if (n == 0) break;
+					parser.write_some(true, buffer.get(), n, ec);
+				}
+				if (!ec) parser.write_some(false, nullptr, 0, ec);
+			}
+			else {
+				const auto& body = request.body();
+				parser.write_some(false, body.data(), body.size(), ec);
+			}
+			if (parser.handler().not_object) {
+				result.errors.push_back("the body is not a json object");
+				return result;
+			}
+			if (ec) {
+				result.errors.push_back("the body is not valid json");
+				return result;
+			}
+			seen = parser.handler().seen;
+		}
+		// the parameters not in a json body
+		std::apply([&](const auto& ...field) {
+			std::size_t i = 0;
+			auto bind = [&](const auto& f) {
+				if (!seen[i]) {
+					auto v = params.is_json() ? params.find_in_query(f.name) : params.find(f.name);
+					using M = std::decay_t<decltype(result.value.*(f.member))>;
+					if (v == nullptr) {
+						if (!field_traits<M>::optional)
+							result.errors.push_back(std::string{ "`" } + f.name + "` is required");
+					}
+					else if (!set_param(result.value.*(f.member), *v)) {
+						result.errors.push_back(std::string{ "`" } + f.name + "` must be " + kind_name<value_type_t<M>>());
+					}
+				}
+				++i;
+			};
+			(bind(field), ...);
+			}, fields);
+		return result;
+	}
+
+}  // bserv
+
+#endif  // _BINDING_HPP
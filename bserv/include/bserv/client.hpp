@@ -10,6 +10,8 @@
 #include <string>
 #include <exception>
 
+#include "memory.hpp"
+
 namespace bserv {
 
 	namespace beast = boost::beast;
@@ -18,8 +20,16 @@ namespace bserv {
 	namespace json = boost::json;
 	using asio::ip::tcp;
 
-	using request_type = http::request<http::string_body>;
-	using response_type = http::response<http::string_body>;
+	// the fields of the requests parsed by the server are allocated from
+	// `pool_allocator`, since a request (and its parser) is created for
+	// each message. the client takes `http::request<http::string_body>`,
+	// and the requests of the server for forwarding them.
+	// so are the fields of the response of a connection, which is
+	// reused for its requests, and whose fields are set for each of them.
+	// the client returns `http::response<http::string_body>`.
+	using fields_type = http::basic_fields<pool_allocator<char>>;
+	using request_type = http::request<http::string_body, fields_type>;
+	using response_type = http::response<http::string_body, fields_type>;
 
 	class request_failed_exception
 		: public std::exception {
@@ -37,7 +47,14 @@ namespace bserv {
 		const std::string& port,
 		const http::request<http::string_body>& req);
 
-	request_type get_request(
+	http::response<http::string_body> http_client_send(
+		asio::io_context& ioc,
+		asio::yield_context& yield,
+		const std::string& host,
+		const std::string& port,
+		const request_type& req);
+
+	http::request<http::string_body> get_request(
 		const std::string& host,
 		const std::string& target,
 		const http::verb& method,
@@ -56,20 +73,32 @@ namespace bserv {
 			const http::request<http::string_body>& req) {
 			return http_client_send(ioc_, yield_, host, port, req);
 		}
+		http::response<http::string_body> request(
+			const std::string& host,
+			const std::string& port,
+			const request_type& req) {
+			return http_client_send(ioc_, yield_, host, port, req);
+		}
 		boost::json::value request_for_value(
 			const std::string& host,
 			const std::string& port,
 			const http::request<http::string_body>& req) {
 			return boost::json::parse(request(host, port, req).body());
 		}
+		boost::json::value request_for_value(
+			const std::string& host,
+			const std::string& port,
+			const request_type& req) {
+			return boost::json::parse(request(host, port, req).body());
+		}
 
-		response_type send(
+		http::response<http::string_body> send(
 			const std::string& host,
 			const std::string& port,
 			const std::string& target,
 			const http::verb& method,
 			const boost::json::value& val) {
-			request_type req = get_request(host, target, method, val);
+			auto req = get_request(host, target, method, val);
 			return request(host, port, req);
 		}
 		boost::json::value send_for_value(
@@ -78,11 +107,11 @@ namespace bserv {
 			const std::string& target,
 			const http::verb& method,
 			const boost::json::value& val) {
-			request_type req = get_request(host, target, method, val);
+			auto req = get_request(host, target, method, val);
 			return request_for_value(host, port, req);
 		}
 
-		response_type get(
+		http::response<http::string_body> get(
 			const std::string& host,
 			const std::string& port,
 			const std::string& target,
@@ -96,7 +125,7 @@ namespace bserv {
 			const boost::json::value& val) {
 			return send_for_value(host, port, target, http::verb::get, val);
 		}
-		response_type put(
+		http::response<http::string_body> put(
 			const std::string& host,
 			const std::string& port,
 			const std::string& target,
@@ -110,7 +139,7 @@ namespace bserv {
 			const boost::json::value& val) {
 			return send_for_value(host, port, target, http::verb::put, val);
 		}
-		response_type post(
+		http::response<http::string_body> post(
 			const std::string& host,
 			const std::string& port,
 			const std::string& target,
@@ -124,7 +153,7 @@ namespace bserv {
 			const boost::json::value& val) {
 			return send_for_value(host, port, target, http::verb::post, val);
 		}
-		response_type delete_(
+		http::response<http::string_body> delete_(
 			const std::string& host,
 			const std::string& port,
 			const std::string& target,
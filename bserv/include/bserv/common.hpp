@@ -5,13 +5,24 @@
 #define _WIN32_WINNT 0x0601
 #endif
 
+#include "admission.hpp"
+#include "binding.hpp"
 #include "client.hpp"
 #include "config.hpp"
 #include "database.hpp"
+#include "headers.hpp"
+#include "hub.hpp"
 #include "logging.hpp"
+#include "memory.hpp"
+#include "msgpack.hpp"
+#include "multipart.hpp"
+#include "notification.hpp"
+#include "params.hpp"
+#include "rate_limit.hpp"
 #include "router.hpp"
 #include "server.hpp"
 #include "session.hpp"
+#include "stream.hpp"
 #include "utils.hpp"
 #include "websocket.hpp"
 
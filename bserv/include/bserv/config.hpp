@@ -4,7 +4,9 @@
 #include <iostream>
 #include <string>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <vector>
 #include <thread>
 
 namespace bserv {
@@ -16,15 +18,96 @@ namespace bserv {
 		std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
 
 	const std::size_t PAYLOAD_LIMIT = 8 * 1024 * 1024;
+	// the default body limit of the routes streaming the request body
+	const std::uint64_t STREAMING_PAYLOAD_LIMIT = 1024ull * 1024 * 1024;
+	// the maximum size of a field (not a file) of a multipart form
+	const std::size_t MULTIPART_FIELD_LIMIT = 64 * 1024;
 	const int EXPIRY_TIME = 30;  // seconds
+	// the capacity of the body of a request kept by a connection
+	// for the next request
+	const std::size_t REQUEST_BODY_RETAINED = 64 * 1024;
+	// the capacity of the body of a response kept by a connection
+	// for the next response
+	const std::size_t RESPONSE_BODY_RETAINED = 64 * 1024;
+	// the memory retained by `pool_allocator` for each size class on each thread
+	const std::size_t POOL_RETAINED_BYTES = 1024 * 1024;
 
 	const std::size_t LOG_ROTATION_SIZE = 8 * 1024 * 1024;
 	//const std::string LOG_PATH = "./log/" + NAME;
 	const std::string LOG_PATH = "";
 
+	// the compression level of the responses in [1, 9], 0 disables it
+	const int COMPRESSION_LEVEL = 6;
+	// a response smaller than this is not compressed
+	const std::size_t COMPRESSION_THRESHOLD = 1024;
+	// the byte budget of the static files compressed in memory
+	const std::size_t STATIC_GZIP_CACHE_SIZE = 16 * 1024 * 1024;
+
+	// the maximum size of the db connection pool
 	const int NUM_DB_CONN = 10;
+	// the minimum size of the db connection pool
+	const int MIN_DB_CONN = 1;
+	const int DB_HEALTH_CHECK_INTERVAL = 30;  // seconds
+	const int DB_IDLE_TIMEOUT = 300;  // seconds
+	// a connection idle for longer than this is pinged on checkout
+	const int DB_VALIDATE_AFTER = 5;  // seconds
+	const int DB_MIN_RECONNECT_BACKOFF = 100;  // milliseconds
+	const int DB_MAX_RECONNECT_BACKOFF = 10000;  // milliseconds
 	//const std::string DB_CONN_STR = "dbname=bserv";
 	const std::string DB_CONN_STR = "";
+	// the connection strings of the read replicas
+	const std::vector<std::string> DB_REPLICA_CONN_STRS{};
+	// the byte budget of the db result cache, 0 disables it
+	const std::size_t DB_CACHE_SIZE = 0;
+
+	// the default number of messages that can be queued on a websocket
+	// session before it is treated as a slow consumer by `websocket_hub`
+	const std::size_t WEBSOCKET_MAX_QUEUE_SIZE = 1024;
+	// the default number of bytes that can be queued on a websocket
+	// session before the producers are blocked
+	const std::size_t WEBSOCKET_HIGH_WATER_MARK = 1024 * 1024;
+	// the defaults of permessage-deflate (see `path_holder::deflate`)
+	const int WEBSOCKET_DEFLATE_WINDOW_BITS = 15;
+	const int WEBSOCKET_DEFLATE_MEM_LEVEL = 8;
+	const std::size_t WEBSOCKET_DEFLATE_THRESHOLD = 256;
+	// a ping is sent if nothing is received for this long,
+	// and the session is closed if nothing is received for twice as long
+	const int WEBSOCKET_PING_INTERVAL = 30;  // seconds
+	// a session is closed if no message is read or written for this long,
+	// 0 disables it
+	const int WEBSOCKET_IDLE_TIMEOUT = 600;  // seconds
+	const std::size_t MAX_WEBSOCKET_SESSIONS = 10000;
+	const std::size_t MAX_WEBSOCKET_SESSIONS_PER_IP = 100;
+
+	// the maximum number of open http connections,
+	// the listener stops accepting at the cap (see `admission_controller`)
+	const std::size_t MAX_CONNECTIONS = 10000;
+	// the bounds of the number of requests being handled,
+	// the requests beyond it are answered with 503
+	const std::size_t MIN_REQUESTS = 16;
+	const std::size_t MAX_REQUESTS = 1024;
+	// the limit of the requests adapts to keep their latency within this,
+	// 0 disables it (the limit is `MAX_REQUESTS`)
+	const int ADMISSION_TARGET_LATENCY = 0;  // milliseconds
+	const double ADMISSION_DECREASE_FACTOR = 0.9;
+	// the `Retry-After` of 503
+	const int ADMISSION_RETRY_AFTER = 1;  // seconds
+
+	// the buckets of each rate limited route are split into this many shards
+	const std::size_t RATE_LIMIT_SHARDS = 16;
+	// the maximum number of buckets of a shard
+	const std::size_t RATE_LIMIT_SHARD_BUCKETS = 4096;
+	// the `Retry-After` of 429
+	const int RATE_LIMIT_RETRY_AFTER = 1;  // seconds
+
+	// on SIGINT or SIGTERM, the requests being handled may take this long
+	// to finish before the server stops, 0 stops immediately
+	const int SHUTDOWN_TIMEOUT = 30;  // seconds
+	// when the server is shutting down, an idle keep-alive connection
+	// is closed if no request is received within this
+	const int SHUTDOWN_IDLE_GRACE = 500;  // milliseconds
+	// how often it is checked whether all the connections are closed
+	const int SHUTDOWN_POLL_INTERVAL = 100;  // milliseconds
 
 #ifdef _MSC_VER
 	const std::size_t STACK_SIZE = 1024 * 1024;
@@ -43,8 +126,24 @@ public: \
 		decl_field(int, num_threads, NUM_THREADS)
 		decl_field(std::size_t, log_rotation_size, LOG_ROTATION_SIZE)
 		decl_field(std::string, log_path, LOG_PATH)
+		decl_field(int, compression_level, COMPRESSION_LEVEL)
+		decl_field(std::size_t, compression_threshold, COMPRESSION_THRESHOLD)
 		decl_field(int, num_db_conn, NUM_DB_CONN)
+		decl_field(int, min_db_conn, MIN_DB_CONN)
+		decl_field(int, db_health_check_interval, DB_HEALTH_CHECK_INTERVAL)
+		decl_field(int, db_idle_timeout, DB_IDLE_TIMEOUT)
 		decl_field(std::string, db_conn_str, DB_CONN_STR)
+		decl_field(std::vector<std::string>, db_replica_conn_strs, DB_REPLICA_CONN_STRS)
+		decl_field(std::size_t, db_cache_size, DB_CACHE_SIZE)
+		decl_field(int, websocket_ping_interval, WEBSOCKET_PING_INTERVAL)
+		decl_field(int, websocket_idle_timeout, WEBSOCKET_IDLE_TIMEOUT)
+		decl_field(std::size_t, max_websocket_sessions, MAX_WEBSOCKET_SESSIONS)
+		decl_field(std::size_t, max_websocket_sessions_per_ip, MAX_WEBSOCKET_SESSIONS_PER_IP)
+		decl_field(std::size_t, max_connections, MAX_CONNECTIONS)
+		decl_field(std::size_t, min_requests, MIN_REQUESTS)
+		decl_field(std::size_t, max_requests, MAX_REQUESTS)
+		decl_field(int, admission_target_latency, ADMISSION_TARGET_LATENCY)
+		decl_field(int, shutdown_timeout, SHUTDOWN_TIMEOUT)
 	public:
 		server_config() = default;
 	};
@@ -4,12 +4,21 @@
 #include <boost/json.hpp>
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
-#include <queue>
+#include <list>
+#include <map>
+#include <set>
+#include <deque>
+#include <tuple>
 #include <optional>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <memory>
+#include <chrono>
+#include <limits>
 #include <initializer_list>
 
 #include <pqxx/pqxx>
@@ -19,6 +28,8 @@
 // including only pqxx is not enough
 #include <pqxx/result>
 
+#include "config.hpp"
+
 namespace bserv {
 
 	using raw_db_connection_type = pqxx::connection;
@@ -30,6 +41,7 @@ namespace bserv {
 	public:
 		db_field(const pqxx::field& field) : field_{ field } {}
 		const char* c_str() const { return field_.c_str(); }
+		std::size_t size() const { return field_.size(); }
 		template <typename Type>
 		Type as() const { return field_.as<Type>(); }
 		bool is_null() const { return field_.is_null(); }
@@ -67,6 +79,56 @@ namespace bserv {
 		std::string query() const { return result_.query(); }
 	};
 
+	// caches the results of read queries, keyed by the query text
+	// (with all the parameters filled in).
+	// each entry expires after its own ttl and records the tables
+	// it depends on, so that a committed write to any of these tables
+	// removes it. when the total size of the cached results exceeds
+	// the byte budget, the least recently used entries are evicted.
+	class db_result_cache {
+	private:
+		using time_point = std::chrono::steady_clock::time_point;
+		struct entry {
+			db_result result;
+			time_point expiry;
+			std::size_t bytes;
+			std::vector<std::string> tables;
+			std::list<std::string>::iterator lru;
+		};
+		const std::size_t capacity_;
+		std::size_t size_;
+		// increased by each invalidation, see `epoch`
+		std::uint64_t epoch_;
+		std::map<std::string, entry> entries_;
+		// the front element is the most recently used query
+		std::list<std::string> lru_;
+		// table -> the queries depending on it
+		std::map<std::string, std::set<std::string>> tables_;
+		mutable std::mutex lock_;
+		void erase(std::map<std::string, entry>::iterator iterator);
+	public:
+		// `capacity` is the byte budget
+		db_result_cache(std::size_t capacity)
+			: capacity_{ capacity }, size_{ 0 }, epoch_{ 0 } {}
+		// if `query` is cached and has not expired, the result will be
+		// placed in `result` and this function returns `true`.
+		bool try_get(const std::string& query, db_result& result);
+		// the value should be obtained before the query is executed.
+		// if any invalidation happens in between, `put` ignores the
+		// result, since it might have been read before the write
+		// was committed.
+		std::uint64_t epoch() const;
+		void put(
+			const std::string& query, const db_result& result,
+			std::chrono::milliseconds ttl,
+			const std::vector<std::string>& tables,
+			std::uint64_t epoch);
+		// removes all the entries depending on `table`
+		void invalidate(const std::string& table);
+		// the total size (in bytes) of the cached results
+		std::size_t size() const;
+	};
+
 	class db_connection_manager;
 
 	class db_connection {
@@ -82,33 +144,153 @@ namespace bserv {
 		db_connection(const db_connection&) = delete;
 		db_connection& operator=(const db_connection&) = delete;
 		// during the destruction, it should put itself back to the 
-		// manager's queue
+		// manager's pool
 		~db_connection();
 		raw_db_connection_type& get() { return *conn_; }
+		// the result cache of the manager, `nullptr` if disabled
+		std::shared_ptr<db_result_cache> cache() const;
+	};
+
+	// thrown if a new database connection cannot be opened,
+	// either because the attempt failed or because the manager
+	// is waiting for the backoff after a failed attempt.
+	class db_connection_unavailable : public std::exception {
+	private:
+		std::string msg_;
+	public:
+		db_connection_unavailable(const std::string& msg)
+			: msg_{ msg } {}
+		const char* what() const noexcept { return msg_.c_str(); }
 	};
 
-	// provides the database connection pool functionality
+	struct db_pool_stats {
+		// the number of open connections (in use or idle)
+		std::size_t size;
+		std::size_t in_use;
+		std::size_t idle;
+		// the number of requests blocked in `get_or_block`
+		std::size_t waiters;
+		// the number of broken connections successfully reopened
+		std::size_t reconnects;
+		std::size_t failed_reconnects;
+	};
+
+	// the settings of `db_connection_manager`
+	struct db_pool_options {
+		int min_size = MIN_DB_CONN;
+		int max_size = NUM_DB_CONN;
+		// the byte budget of the result cache, which is disabled if it is 0
+		std::size_t cache_size = 0;
+		std::chrono::seconds health_check_interval{ DB_HEALTH_CHECK_INTERVAL };
+		std::chrono::seconds idle_timeout{ DB_IDLE_TIMEOUT };
+		// an idle connection is pinged on checkout if it has been idle
+		// for longer than this, so that a restarted server is noticed
+		// before a request fails. 0 pings on every checkout.
+		std::chrono::seconds validate_after{ DB_VALIDATE_AFTER };
+	};
+
+	// provides the database connection pool functionality.
+	// - read-only work can be routed to replicas (see `add_replica`
+	//   and `get_read_or_block`).
+	// - the pool opens `min_size` connections at startup and grows up
+	//   to `max_size` under load. connections idle for longer than
+	//   `idle_timeout` are closed, as long as `min_size` remain.
+	// - a background thread checks the idle connections every
+	//   `health_check_interval` and reopens the broken ones.
+	// - a connection idle for longer than `validate_after` is pinged
+	//   on checkout, and a broken one is reopened lazily.
+	//   if reopening fails, the following attempts are delayed by an
+	//   exponential backoff, during which `db_connection_unavailable`
+	//   is thrown immediately.
 	class db_connection_manager {
 	private:
-		std::queue<std::shared_ptr<raw_db_connection_type>> queue_;
-		// this lock is for manipulating the `queue_`
-		mutable std::mutex queue_lock_;
-		// since C++ 17 doesn't provide the semaphore functionality,
-		// mutex is used to mimic it. (boost provides it)
-		// if there are no available connections, trying to lock on
-		// it will cause blocking.
-		mutable std::mutex counter_lock_;
+		using time_point = std::chrono::steady_clock::time_point;
+		struct idle_connection {
+			std::shared_ptr<raw_db_connection_type> conn;
+			// when it was returned to the pool
+			time_point since;
+		};
+		const std::string conn_str_;
+		const std::size_t min_size_;
+		const std::size_t max_size_;
+		const std::chrono::seconds health_check_interval_;
+		const std::chrono::seconds idle_timeout_;
+		const std::chrono::seconds validate_after_;
+		// the most recently returned connection is at the back
+		std::deque<idle_connection> idle_;
+		// the number of connections, including those in use
+		// and those being opened or checked
+		std::size_t size_;
+		std::size_t in_use_;
+		std::size_t waiters_;
+		std::size_t reconnects_;
+		std::size_t failed_reconnects_;
+		std::chrono::milliseconds backoff_;
+		time_point retry_after_;
+		// a replica is marked down when one of its connections breaks
+		bool is_replica_;
+		bool stopped_;
+		// this lock is for manipulating all the fields above
+		mutable std::mutex lock_;
+		// notified when a connection (or a slot) becomes available
+		std::condition_variable available_;
+		// notified when the manager is being destroyed
+		std::condition_variable stopping_;
+		std::thread health_checker_;
+		std::shared_ptr<db_result_cache> cache_;
+		// each replica has a pool of its own
+		std::vector<std::shared_ptr<db_connection_manager>> replicas_;
 		friend db_connection;
+		// opens a new connection, `reconnect` indicates whether it
+		// replaces a broken one.
+		std::shared_ptr<raw_db_connection_type> connect(bool reconnect);
+		// called by `db_connection` when it is destroyed
+		void put_back(std::shared_ptr<raw_db_connection_type> conn);
+		void check_health();
 	public:
-		db_connection_manager(const std::string& conn_str, int n) {
-			for (int i = 0; i < n; ++i)
-				queue_.emplace(
-					std::make_shared<raw_db_connection_type>(conn_str));
-		}
-		// if there are no available database connections, this function
-		// blocks until there is any;
+		db_connection_manager(
+			const std::string& conn_str,
+			const db_pool_options& options);
+		// a pool of fixed size `n`, `cache_size` is the byte budget
+		// of the result cache, which is disabled if it is 0.
+		db_connection_manager(
+			const std::string& conn_str, int n,
+			std::size_t cache_size = 0)
+			: db_connection_manager{ conn_str, db_pool_options{ n, n, cache_size } } {}
+		~db_connection_manager();
+		// non-copiable, non-assignable
+		db_connection_manager(const db_connection_manager&) = delete;
+		db_connection_manager& operator=(const db_connection_manager&) = delete;
+		// if there are no available database connections and the pool
+		// cannot grow, this function blocks until there is any;
 		// otherwise, this function returns a pointer to `db_connection`.
 		std::shared_ptr<db_connection> get_or_block();
+		// adds a read replica, whose pool has the same settings as this one.
+		// it should be called before the manager is used.
+		// when a connection to a replica breaks while it is used, the
+		// replica is marked down (and its idle connections are closed)
+		// until the reconnect backoff expires.
+		// NOTE: since replication lags behind, a write committed to the
+		//       primary might not be visible on the replicas immediately.
+		//       so the reads from the replicas are not cached: a lagging
+		//       replica could cache a result from before a commit that
+		//       has just invalidated it.
+		void add_replica(const std::string& conn_str);
+		// returns a connection to the least loaded replica that is available.
+		// a replica drops out while it is waiting to reconnect, and it is
+		// skipped if opening a connection to it fails.
+		// if no replica is available, a connection to the primary is returned.
+		std::shared_ptr<db_connection> get_read_or_block();
+		std::shared_ptr<db_result_cache> cache() const { return cache_; }
+		db_pool_stats stats() const;
+		// `false` if it is waiting to reconnect after a failed attempt
+		bool available() const;
+		// the number of connections in use, plus the number of waiters
+		std::size_t load() const;
+		// waits up to `timeout` for the connections in use to be returned,
+		// then closes the idle connections (and those of the replicas).
+		// it is called when the server shuts down.
+		void close(std::chrono::steady_clock::duration timeout);
 	};
 
 	// **************************************************************************
@@ -310,6 +492,41 @@ namespace bserv {
 			return { params->get_value(tx)... };
 		}
 
+		// converts a json value into a field for `COPY ... FROM STDIN`,
+		// `std::nullopt` stands for `null`.
+		inline std::optional<std::string> convert_copy_field(
+			const boost::json::value& value) {
+			if (value.is_null()) {
+				return std::nullopt;
+			}
+			else if (value.is_string()) {
+				return std::string{ value.as_string() };
+			}
+			else if (value.is_bool()) {
+				return value.as_bool() ? "true" : "false";
+			}
+			else if (value.is_int64()
+				|| value.is_uint64()
+				|| value.is_double()) {
+				return boost::json::serialize(value);
+			}
+			else {
+				throw unsupported_json_value_type{};
+			}
+		}
+
+		// quotes and joins the column names: "col1", "col2", ...
+		inline std::string quote_columns(
+			raw_db_transaction_type& tx,
+			const std::vector<std::string>& columns) {
+			std::string res;
+			for (const auto& column : columns) {
+				if (res.size() != 0) res += ", ";
+				res += tx.quote_name(column);
+			}
+			return res;
+		}
+
 		// *************************************
 
 		class db_field_holder {
@@ -395,6 +612,14 @@ namespace bserv {
 		const char* what() const noexcept { return msg_.c_str(); }
 	};
 
+	// the cursor of a page is malformed, which is an error of the client,
+	// so it is answered with `400 Bad Request`
+	class invalid_cursor_exception : public std::exception {
+	public:
+		invalid_cursor_exception() = default;
+		const char* what() const noexcept { return "invalid cursor"; }
+	};
+
 	class db_relation_to_object {
 	private:
 		std::vector<std::shared_ptr<db_internal::db_field_holder>> fields_;
@@ -431,13 +656,54 @@ namespace bserv {
 		}
 	};
 
+	namespace db_internal {
+
+		// replaces the placeholders ("?") in `s` with `params`,
+		// see `db_transaction::exec` for the details.
+		template <typename ...Params>
+		std::string build_query(
+			raw_db_transaction_type& tx,
+			const std::string& s, const Params&... params) {
+			std::vector<std::string> param_vec =
+				convert_parameters(
+					tx, convert_parameter(params)...);
+			std::size_t idx = 0;
+			std::string query;
+			for (std::size_t i = 0; i < s.length(); ++i) {
+				if (s[i] == '?') {
+					if (i + 1 < s.length() && s[i + 1] == '?') {
+						query += s[++i];
+					}
+					else {
+						if (idx < param_vec.size()) {
+							query += param_vec[idx++];
+						}
+						else throw std::out_of_range{ "too few parameters" };
+					}
+				}
+				else query += s[i];
+			}
+			if (idx != param_vec.size())
+				throw invalid_operation_exception{ "too many parameters" };
+			return query;
+		}
+
+	}  // db_internal
+
+	class db_pipeline;
+
 	class db_transaction {
 	private:
 		raw_db_transaction_type tx_;
+		std::shared_ptr<db_result_cache> cache_;
+		// the tables written by this transaction
+		std::vector<std::string> written_tables_;
+		friend db_pipeline;
 	public:
 		db_transaction(
 			std::shared_ptr<db_connection> connection_ptr
-		) : tx_{ connection_ptr->get() } {}
+		) : tx_{ connection_ptr->get() },
+			cache_{ connection_ptr->cache() } {}
 		// non-copiable, non-assignable
 		db_transaction(const db_transaction&) = delete;
 		db_transaction& operator=(const db_transaction&) = delete;
@@ -454,33 +720,192 @@ namespace bserv {
 		//       But, "??" in the parameters remains.
 		template <typename ...Params>
 		db_result exec(const std::string& s, const Params&... params) {
-			std::vector<std::string> param_vec =
-				db_internal::convert_parameters(
-					tx_, db_internal::convert_parameter(params)...);
-			std::size_t idx = 0;
-			std::string query;
-			for (std::size_t i = 0; i < s.length(); ++i) {
-				if (s[i] == '?') {
-					if (i + 1 < s.length() && s[i + 1] == '?') {
-						query += s[++i];
-					}
-					else {
-						if (idx < param_vec.size()) {
-							query += param_vec[idx++];
-						}
-						else throw std::out_of_range{ "too few parameters" };
-					}
-				}
-				else query += s[i];
+			return tx_.exec(db_internal::build_query(tx_, s, params...));
+		}
+		// the same as `exec`, except that the result is looked up in (and
+		// stored into) the result cache of the connection manager.
+		// `tables` are the tables the query reads from, a committed write
+		// to any of them (see `invalidate_on_commit`) drops the result.
+		// the cache is bypassed if it is disabled or if this transaction
+		// has written to any of `tables`.
+		// Usage:
+		// exec_cached(std::chrono::seconds{ 5 }, { "auth_user" },
+		//             "select count(*) from auth_user;");
+		template <typename ...Params>
+		db_result exec_cached(
+			std::chrono::milliseconds ttl,
+			const std::vector<std::string>& tables,
+			const std::string& s, const Params&... params) {
+			std::string query = db_internal::build_query(tx_, s, params...);
+			bool bypass = cache_ == nullptr;
+			for (std::size_t i = 0; !bypass && i < tables.size(); ++i)
+				for (const auto& table : written_tables_)
+					if (table == tables[i]) bypass = true;
+			if (bypass) return tx_.exec(query);
+			db_result result;
+			if (cache_->try_get(query, result)) return result;
+			std::uint64_t epoch = cache_->epoch();
+			result = tx_.exec(query);
+			cache_->put(query, result, ttl, tables, epoch);
+			return result;
+		}
+		// tags this transaction as a write to `table`: once it is committed,
+		// the cached results depending on `table` are removed.
+		void invalidate_on_commit(const std::string& table) {
+			written_tables_.emplace_back(table);
+		}
+		// inserts all the `rows` into `table` using a single
+		// `COPY ... FROM STDIN` statement (`pqxx::stream_to`),
+		// instead of issuing one `insert` for each row.
+		// each element of `rows` must be a json array, whose elements
+		// correspond to `columns` (null, bool, number or string).
+		// Usage:
+		// bulk_insert("auth_user", {"username", "is_active"},
+		//             boost::json::array{{"user1", true}, {"user2", false}});
+		// returns the number of rows inserted.
+		std::size_t bulk_insert(
+			const std::string& table,
+			const std::vector<std::string>& columns,
+			const boost::json::array& rows) {
+			if (rows.empty()) return 0;
+			pqxx::stream_to stream = pqxx::stream_to::raw_table(
+				tx_, tx_.quote_name(table),
+				db_internal::quote_columns(tx_, columns));
+			std::vector<std::optional<std::string>> fields;
+			fields.reserve(columns.size());
+			for (const auto& row : rows) {
+				if (!row.is_array())
+					throw invalid_operation_exception{
+						"each row should be a json array" };
+				const boost::json::array& values = row.as_array();
+				if (values.size() != columns.size())
+					throw invalid_operation_exception{
+						"the number of fields does not match the number of columns" };
+				fields.clear();
+				for (const auto& value : values)
+					fields.emplace_back(db_internal::convert_copy_field(value));
+				stream.write_row(fields);
 			}
-			if (idx != param_vec.size())
-				throw invalid_operation_exception{ "too many parameters" };
-			return tx_.exec(query);
+			stream.complete();
+			return rows.size();
+		}
+		// the same as above, except that each row is a typed tuple:
+		// bulk_insert("auth_user", {"username", "is_active"},
+		//             std::vector<std::tuple<std::string, bool>>{...});
+		template <typename ...Types>
+		std::size_t bulk_insert(
+			const std::string& table,
+			const std::vector<std::string>& columns,
+			const std::vector<std::tuple<Types...>>& rows) {
+			if (sizeof...(Types) != columns.size())
+				throw invalid_operation_exception{
+					"the number of fields does not match the number of columns" };
+			if (rows.empty()) return 0;
+			pqxx::stream_to stream = pqxx::stream_to::raw_table(
+				tx_, tx_.quote_name(table),
+				db_internal::quote_columns(tx_, columns));
+			for (const auto& row : rows)
+				stream.write_row(row);
+			stream.complete();
+			return rows.size();
+		}
+		void commit() {
+			tx_.commit();
+			if (cache_ != nullptr)
+				for (const auto& table : written_tables_)
+					cache_->invalidate(table);
 		}
-		void commit() { tx_.commit(); }
 		void abort() { tx_.abort(); }
 	};
 
+	// sends several independent queries of a transaction to the
+	// database server at once (`pqxx::pipeline`), so that they cost
+	// one network round trip instead of one for each query.
+	// Usage:
+	// db_pipeline pipeline{ tx };
+	// auto count_id = pipeline.insert("select count(*) from ?;", db_name("auth_user"));
+	// auto users_id = pipeline.insert("select * from auth_user limit ?;", 10);
+	// pipeline.complete();  // optional, flushes all the queries
+	// db_result count = pipeline.retrieve(count_id);
+	// db_result users = pipeline.retrieve(users_id);
+	// NOTE: the transaction must not be used directly (`exec`, `commit`, ...)
+	//       while the pipeline is still alive.
+	class db_pipeline {
+	public:
+		using query_id = pqxx::pipeline::query_id;
+	private:
+		raw_db_transaction_type& tx_;
+		pqxx::pipeline pipeline_;
+	public:
+		db_pipeline(db_transaction& tx)
+			: tx_{ tx.tx_ }, pipeline_{ tx.tx_ } {
+			// keeps all the queries until they are retrieved
+			// or `complete` is called.
+			pipeline_.retain(std::numeric_limits<int>::max());
+		}
+		// non-copiable, non-assignable
+		db_pipeline(const db_pipeline&) = delete;
+		db_pipeline& operator=(const db_pipeline&) = delete;
+		// queues the query, placeholders are the same as `db_transaction::exec`.
+		template <typename ...Params>
+		query_id insert(const std::string& s, const Params&... params) {
+			return pipeline_.insert(db_internal::build_query(tx_, s, params...));
+		}
+		// sends all the queued queries and waits for their results.
+		void complete() { pipeline_.complete(); }
+		// returns the result of the query, waiting for it if necessary.
+		db_result retrieve(query_id id) { return pipeline_.retrieve(id); }
+	};
+
+	// a page of objects returned by `db_keyset_paginator`
+	struct db_page {
+		std::vector<boost::json::object> items;
+		// opaque cursors of the adjacent pages,
+		// `std::nullopt` if there is no such page.
+		std::optional<std::string> previous;
+		std::optional<std::string> next;
+	};
+
+	// paginates `table` ordered by a unique `key` column using keyset
+	// (seek) queries: a page starts right after (or before) the key of
+	// the last (or first) row of its neighbour, so the cost of fetching
+	// a page does not depend on its position, unlike `limit ? offset ?`.
+	// Usage:
+	// db_keyset_paginator users{ "auth_user", "id", 10, orm_user };
+	// db_page page = users.fetch(tx, after, before);
+	// `after` and `before` are the cursors in `page.next` and
+	// `page.previous` respectively (or empty strings for the first page).
+	// NOTE: `key` must be one of the fields of `orm`.
+	class db_keyset_paginator {
+	private:
+		const std::string table_;
+		const std::string key_;
+		const std::size_t page_size_;
+		db_relation_to_object orm_;
+	public:
+		db_keyset_paginator(
+			const std::string& table,
+			const std::string& key,
+			std::size_t page_size,
+			const db_relation_to_object& orm)
+			: table_{ table }, key_{ key },
+			page_size_{ page_size }, orm_{ orm } {}
+		// if both are empty, the first page is returned.
+		// throws `invalid_cursor_exception` if the cursor is malformed.
+		db_page fetch(
+			db_transaction& tx,
+			const std::string& after,
+			const std::string& before = "");
+		// the number of rows estimated by the planner statistics,
+		// which is cheap but might be out of date.
+		// `std::nullopt` if the table has not been analyzed yet.
+		std::optional<std::size_t> approximate_count(db_transaction& tx);
+		// the exact number of rows, cached for `ttl` in the result cache
+		// (if it is enabled). committed writes tagged with `table` drop it.
+		// on a replica it is not cached, and it may lag behind the primary.
+		std::size_t count(db_transaction& tx, std::chrono::milliseconds ttl);
+	};
+
 
 	// TODO: add support for time conversions between postgresql and c++, use timestamp?
 	//       what about time zone?
@@ -0,0 +1,59 @@
+#ifndef _HEADERS_HPP
+#define _HEADERS_HPP
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <cstddef>
+#include <string>
+#include <array>
+#include <utility>
+#include <initializer_list>
+
+namespace bserv {
+
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+	namespace asio = boost::asio;
+
+	// the length of an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+	const std::size_t HTTP_DATE_SIZE = 29;
+
+	// the current time as the value of the `Date` header.
+	// it is formatted at most once per second on each thread,
+	// and the returned view is valid until the next second on the thread.
+	beast::string_view http_date();
+
+	// a response serialized once, for the statuses sent often with
+	// the same body (e.g. 404 to scanners): the status line, the default
+	// fields (`Server`, `Content-Type`, `Content-Length`, ...) and the
+	// body are kept as immutable blocks for each version and `keep_alive`,
+	// and only the `Date` is added when it is written.
+	class prebuilt_response {
+	public:
+		// the buffers of the whole response
+		using buffers_type = std::array<asio::const_buffer, 4>;
+	private:
+		const http::status status_;
+		const std::string body_;
+		// [http/1.1][keep_alive]
+		std::string heads_[2][2];
+	public:
+		prebuilt_response(
+			http::status status,
+			std::string body,
+			std::initializer_list<std::pair<http::field, std::string>> fields = {},
+			const std::string& content_type = "text/html");
+		prebuilt_response(const prebuilt_response&) = delete;
+		prebuilt_response& operator=(const prebuilt_response&) = delete;
+		http::status status() const { return status_; }
+		const std::string& body() const { return body_; }
+		// `date` (`HTTP_DATE_SIZE` bytes, see `http_date`) must be
+		// kept alive until the buffers are written.
+		buffers_type buffers(
+			unsigned version, bool keep_alive, const char* date) const;
+	};
+
+}  // bserv
+
+#endif  // _HEADERS_HPP
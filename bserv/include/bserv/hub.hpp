@@ -0,0 +1,98 @@
+#ifndef _HUB_HPP
+#define _HUB_HPP
+
+#include <boost/json.hpp>
+
+#include <cstddef>
+#include <string>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+
+#include "config.hpp"
+#include "websocket.hpp"
+
+namespace bserv {
+
+	// what to do with a session whose queue is full
+	enum class slow_consumer_policy {
+		// skips the message for the session
+		drop,
+		// closes the session
+		disconnect
+	};
+
+	struct websocket_hub_stats {
+		std::size_t topics;
+		std::size_t sessions;
+		std::size_t published;
+		std::size_t dropped;
+		std::size_t disconnected;
+	};
+
+	class websocket_hub;
+
+	// unsubscribes when it is destroyed.
+	class websocket_subscription {
+	private:
+		std::weak_ptr<websocket_hub> hub_;
+		std::string topic_;
+		std::size_t id_;
+	public:
+		websocket_subscription(
+			std::weak_ptr<websocket_hub> hub,
+			const std::string& topic, std::size_t id)
+			: hub_{ hub }, topic_{ topic }, id_{ id } {}
+		websocket_subscription(const websocket_subscription&) = delete;
+		websocket_subscription& operator=(const websocket_subscription&) = delete;
+		websocket_subscription(websocket_subscription&&) = default;
+		websocket_subscription& operator=(websocket_subscription&&) = default;
+		~websocket_subscription();
+		const std::string& topic() const { return topic_; }
+	};
+
+	// tracks the websocket sessions subscribed to each topic.
+	// a published message is serialized once, and the same buffer
+	// is queued on all the subscribers (see `websocket_session::send`).
+	// it should be owned by a `std::shared_ptr`.
+	class websocket_hub
+		: public std::enable_shared_from_this<websocket_hub> {
+	private:
+		friend class websocket_subscription;
+		const std::size_t max_queue_size_;
+		const slow_consumer_policy policy_;
+		mutable std::shared_mutex lock_;
+		std::map<std::string,
+			std::map<std::size_t, std::weak_ptr<websocket_session>>> topics_;
+		std::atomic<std::size_t> next_id_;
+		std::atomic<std::size_t> published_;
+		std::atomic<std::size_t> dropped_;
+		std::atomic<std::size_t> disconnected_;
+		void unsubscribe(const std::string& topic, std::size_t id);
+	public:
+		// a session is a slow consumer if more than `max_queue_size`
+		// messages are queued on it, or it reaches its high-water mark
+		// (the hub cannot wait for it to drain).
+		websocket_hub(
+			std::size_t max_queue_size = WEBSOCKET_MAX_QUEUE_SIZE,
+			slow_consumer_policy policy = slow_consumer_policy::drop)
+			: max_queue_size_{ max_queue_size }, policy_{ policy },
+			next_id_{ 0 }, published_{ 0 },
+			dropped_{ 0 }, disconnected_{ 0 } {}
+		websocket_hub(const websocket_hub&) = delete;
+		websocket_hub& operator=(const websocket_hub&) = delete;
+		websocket_subscription subscribe(
+			const std::string& topic,
+			std::shared_ptr<websocket_session> session);
+		// returns the number of sessions the message is queued on
+		std::size_t publish(const std::string& topic, const boost::json::value& message);
+		// `message` is written in a binary frame if `binary` is true
+		std::size_t publish(const std::string& topic,
+			std::shared_ptr<const std::string> message, bool binary = false);
+		websocket_hub_stats stats() const;
+	};
+
+}  // bserv
+
+#endif  // _HUB_HPP
@@ -0,0 +1,224 @@
+#ifndef _MEMORY_HPP
+#define _MEMORY_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "config.hpp"
+
+namespace bserv {
+
+	// a few blocks of memory owned by a session and reused by the
+	// intermediate handlers of its async operations (the operations of
+	// asio and the states of beast's composed operations), which would
+	// otherwise be allocated on the heap for each operation.
+	// a larger request, or one made when all the blocks are in use,
+	// falls back to `operator new`.
+	// it is not thread-safe, the operations using it must not overlap
+	// on different threads (like the reads and writes of a session).
+	class handler_memory {
+	public:
+		static constexpr std::size_t BLOCK_SIZE = 1024;
+		static constexpr std::size_t NUM_BLOCKS = 4;
+	private:
+		struct block {
+			alignas(std::max_align_t) unsigned char data[BLOCK_SIZE];
+		};
+		block blocks_[NUM_BLOCKS];
+		bool in_use_[NUM_BLOCKS];
+	public:
+		handler_memory() : in_use_{} {}
+		handler_memory(const handler_memory&) = delete;
+		handler_memory& operator=(const handler_memory&) = delete;
+		void* allocate(std::size_t size) {
+			if (size <= BLOCK_SIZE) {
+				for (std::size_t i = 0; i < NUM_BLOCKS; ++i) {
+					if (!in_use_[i]) {
+						in_use_[i] = true;
+						return blocks_[i].data;
+					}
+				}
+			}
+			return ::operator new(size);
+		}
+		void deallocate(void* p) {
+			for (std::size_t i = 0; i < NUM_BLOCKS; ++i) {
+				if (p == blocks_[i].data) {
+					in_use_[i] = false;
+					return;
+				}
+			}
+			::operator delete(p);
+		}
+	};
+
+	// the allocator associated with the handlers bound by `bind_handler_memory`
+	template <typename T>
+	class handler_allocator {
+	private:
+		template <typename> friend class handler_allocator;
+		handler_memory& memory_;
+	public:
+		using value_type = T;
+		explicit handler_allocator(handler_memory& memory) noexcept
+			: memory_{ memory } {}
+		template <typename U>
+		handler_allocator(const handler_allocator<U>& other) noexcept
+			: memory_{ other.memory_ } {}
+		T* allocate(std::size_t n) const {
+			return static_cast<T*>(memory_.allocate(sizeof(T) * n));
+		}
+		void deallocate(T* p, std::size_t /*n*/) const {
+			memory_.deallocate(p);
+		}
+		template <typename U>
+		bool operator==(const handler_allocator<U>& other) const noexcept {
+			return &memory_ == &other.memory_;
+		}
+		template <typename U>
+		bool operator!=(const handler_allocator<U>& other) const noexcept {
+			return &memory_ != &other.memory_;
+		}
+	};
+
+	template <typename Handler>
+	class memory_bound_handler {
+	private:
+		handler_memory& memory_;
+		Handler handler_;
+	public:
+		using allocator_type = handler_allocator<Handler>;
+		memory_bound_handler(handler_memory& memory, Handler&& handler)
+			: memory_{ memory }, handler_{ std::move(handler) } {}
+		allocator_type get_allocator() const noexcept {
+			return allocator_type{ memory_ };
+		}
+		template <typename ...Args>
+		void operator()(Args&& ...args) {
+			handler_(std::forward<Args>(args)...);
+		}
+	};
+
+	// `handler` with the allocator using `memory`
+	template <typename Handler>
+	memory_bound_handler<std::decay_t<Handler>> bind_handler_memory(
+		handler_memory& memory, Handler&& handler) {
+		return { memory, std::decay_t<Handler>{ std::forward<Handler>(handler) } };
+	}
+
+	namespace memory_internal {
+
+		// the size classes of `pool_allocator`: 32, 64, ..., 8192 bytes
+		constexpr std::size_t MIN_BLOCK_SIZE = 32;
+		constexpr std::size_t NUM_SIZE_CLASSES = 9;
+		constexpr std::size_t MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << (NUM_SIZE_CLASSES - 1);
+
+		constexpr std::size_t size_class(std::size_t size) {
+			std::size_t c = 0;
+			while ((MIN_BLOCK_SIZE << c) < size) ++c;
+			return c;
+		}
+
+		struct free_block {
+			free_block* next;
+		};
+
+		// it is trivially destructible, so that it can be used
+		// while the other thread-local objects are destroyed
+		struct free_lists {
+			free_block* heads[NUM_SIZE_CLASSES];
+			std::size_t sizes[NUM_SIZE_CLASSES];
+			bool registered;
+			// the blocks freed after this are not retained
+			bool released;
+		};
+
+		// returns the blocks to the heap when the thread exits
+		struct free_lists_releaser {
+			free_lists& lists;
+			~free_lists_releaser() {
+				lists.released = true;
+				for (std::size_t c = 0; c < NUM_SIZE_CLASSES; ++c) {
+					while (free_block* block = lists.heads[c]) {
+						lists.heads[c] = block->next;
+						::operator delete(block);
+					}
+					lists.sizes[c] = 0;
+				}
+			}
+		};
+
+		inline void register_releaser(free_lists& lists) {
+			thread_local free_lists_releaser releaser{ lists };
+		}
+
+		inline free_lists& local_free_lists() {
+			thread_local free_lists lists{};
+			if (!lists.registered) {
+				lists.registered = true;
+				register_releaser(lists);
+			}
+			return lists;
+		}
+
+	}  // memory_internal
+
+	// a stateless allocator backed by per-thread free lists of blocks in
+	// power-of-two size classes (up to 8 KiB), so that the objects
+	// allocated and freed at a high rate (the sessions, the fields of the
+	// requests) reuse the memory instead of going to the heap each time.
+	// a block may be freed on another thread, where it is retained.
+	// each thread retains up to `POOL_RETAINED_BYTES` of each size class.
+	template <typename T>
+	class pool_allocator {
+	public:
+		using value_type = T;
+		pool_allocator() noexcept = default;
+		template <typename U>
+		pool_allocator(const pool_allocator<U>&) noexcept {}
+		T* allocate(std::size_t n) {
+			using namespace memory_internal;
+			static_assert(alignof(T) <= alignof(std::max_align_t),
+				"pool_allocator does not support over-aligned types");
+			std::size_t size = n * sizeof(T);
+			if (size > MAX_BLOCK_SIZE)
+				return static_cast<T*>(::operator new(size));
+			std::size_t c = size_class(size);
+			free_lists& lists = local_free_lists();
+			if (free_block* block = lists.heads[c]) {
+				lists.heads[c] = block->next;
+				--lists.sizes[c];
+				return reinterpret_cast<T*>(block);
+			}
+			return static_cast<T*>(::operator new(MIN_BLOCK_SIZE << c));
+		}
+		void deallocate(T* p, std::size_t n) noexcept {
+			using namespace memory_internal;
+			std::size_t size = n * sizeof(T);
+			if (size > MAX_BLOCK_SIZE) {
+				::operator delete(p);
+				return;
+			}
+			std::size_t c = size_class(size);
+			free_lists& lists = local_free_lists();
+			if (lists.released
+				|| lists.sizes[c] >= POOL_RETAINED_BYTES / (MIN_BLOCK_SIZE << c)) {
+				::operator delete(p);
+				return;
+			}
+			free_block* block = reinterpret_cast<free_block*>(p);
+			block->next = lists.heads[c];
+			lists.heads[c] = block;
+			++lists.sizes[c];
+		}
+		template <typename U>
+		bool operator==(const pool_allocator<U>&) const noexcept { return true; }
+		template <typename U>
+		bool operator!=(const pool_allocator<U>&) const noexcept { return false; }
+	};
+
+}  // bserv
+
+#endif  // _MEMORY_HPP
@@ -0,0 +1,48 @@
+#ifndef _MSGPACK_HPP
+#define _MSGPACK_HPP
+
+#include <boost/json.hpp>
+
+#include <string>
+#include <string_view>
+
+namespace bserv {
+
+	// the encoding of the messages of a websocket route
+	enum class message_codec {
+		// text frames of json
+		json,
+		// binary frames of MessagePack
+		msgpack
+	};
+
+	class msgpack_error : public std::exception {
+	private:
+		const std::string msg_;
+	public:
+		msgpack_error(const std::string& msg) : msg_{ msg } {}
+		const char* what() const noexcept { return msg_.c_str(); }
+	};
+
+	// MessagePack (https://msgpack.org) encoding of `boost::json::value`
+	namespace msgpack {
+
+		// appends the encoding of `val` to `out`, so that the buffer
+		// can be reused by the caller
+		void encode(const boost::json::value& val, std::string& out);
+
+		inline std::string encode(const boost::json::value& val) {
+			std::string out;
+			encode(val, out);
+			return out;
+		}
+
+		// binary data is decoded as strings, extensions are not supported.
+		// throws `msgpack_error` if `data` is not a valid encoding.
+		boost::json::value decode(std::string_view data, boost::json::storage_ptr sp = {});
+
+	}  // msgpack
+
+}  // bserv
+
+#endif  // _MSGPACK_HPP
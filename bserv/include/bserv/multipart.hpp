@@ -0,0 +1,111 @@
+#ifndef _MULTIPART_HPP
+#define _MULTIPART_HPP
+
+#include <boost/beast.hpp>
+#include <boost/json.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <functional>
+
+#include "stream.hpp"
+
+namespace bserv {
+
+	class multipart_error : public std::exception {
+	private:
+		const std::string msg_;
+	public:
+		multipart_error(const std::string& msg) : msg_{ msg } {}
+		const char* what() const noexcept { return msg_.c_str(); }
+	};
+
+	// the header of a part of `multipart/form-data`
+	struct multipart_part {
+		// the `name` of `Content-Disposition`
+		std::string name;
+		// the `filename` of `Content-Disposition` if it is a file part
+		std::optional<std::string> filename;
+		std::string content_type;
+	};
+
+	// the boundary in the `Content-Type` of a multipart body,
+	// `std::nullopt` if it is not `multipart/form-data`
+	std::optional<std::string> multipart_boundary(beast::string_view content_type);
+
+	// an incremental parser of multipart bodies (RFC 7578): the body is
+	// fed in chunks of any size, and the content of each part is passed
+	// to `on_data` as slices of the chunks, without being copied.
+	// the delimiters are searched with `memchr`.
+	// Usage:
+	//   bserv::multipart_parser parser{ boundary };
+	//   parser.on_part_begin = [](const bserv::multipart_part& part) { ... };
+	//   parser.on_data = [](std::string_view data) { ... };
+	//   parser.on_part_end = []() { ... };
+	//   while (...) parser.write(chunk);
+	//   parser.finish();
+	class multipart_parser {
+	private:
+		enum class state {
+			preamble,
+			delimiter,
+			headers,
+			body,
+			epilogue
+		};
+		// "\r\n--" + boundary
+		const std::string delimiter_;
+		state state_;
+		// whether the start of the body has been parsed
+		bool started_;
+		// the bytes left by the previous `write`,
+		// which might be the start of a delimiter or of the headers
+		std::string buffer_;
+		multipart_part part_;
+		std::size_t parse(std::string_view data);
+		std::size_t parse_preamble(std::string_view data);
+		std::size_t parse_delimiter(std::string_view data);
+		std::size_t parse_headers(std::string_view data);
+		std::size_t parse_body(std::string_view data);
+	public:
+		std::function<void(const multipart_part&)> on_part_begin;
+		// called zero or more times for each part
+		std::function<void(std::string_view)> on_data;
+		std::function<void()> on_part_end;
+		explicit multipart_parser(const std::string& boundary);
+		// throws `multipart_error` if the body is malformed.
+		void write(std::string_view data);
+		// throws `multipart_error` if the body is incomplete.
+		void finish();
+		bool done() const { return state_ == state::epilogue; }
+	};
+
+	// the content of a file part is passed chunk by chunk,
+	// and an empty chunk marks the end of the part.
+	using multipart_file_handler =
+		std::function<void(const multipart_part&, std::string_view)>;
+
+	// reads a `multipart/form-data` body from `body`: the fields are
+	// collected into the returned object (a field larger than
+	// `MULTIPART_FIELD_LIMIT` is rejected), and the file parts are
+	// passed to `on_file` as they are received.
+	boost::json::object read_multipart_form(
+		request_body_reader& body,
+		const multipart_file_handler& on_file);
+
+	// the file parts are spooled to temporary files, which are removed
+	// when `body` is destroyed, and given as objects of
+	// `filename`, `content_type`, `size` and `path`.
+	boost::json::object read_multipart_form(request_body_reader& body);
+
+	// parses a `multipart/form-data` body in memory,
+	// the content of a file part is given as `content`.
+	boost::json::object parse_multipart_form(
+		std::string_view body, const std::string& boundary);
+
+}  // bserv
+
+#endif  // _MULTIPART_HPP
@@ -0,0 +1,135 @@
+#ifndef _NOTIFICATION_HPP
+#define _NOTIFICATION_HPP
+
+#include <boost/asio.hpp>
+
+#include <cstddef>
+#include <string>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <optional>
+
+#include <pqxx/pqxx>
+
+#include "websocket.hpp"
+
+namespace bserv {
+
+	namespace asio = boost::asio;
+
+	class db_listener;
+
+	// unsubscribes when it is destroyed.
+	class db_subscription {
+	private:
+		std::weak_ptr<db_listener> listener_;
+		std::string channel_;
+		std::size_t id_;
+	public:
+		db_subscription(
+			std::weak_ptr<db_listener> listener,
+			const std::string& channel, std::size_t id)
+			: listener_{ listener }, channel_{ channel }, id_{ id } {}
+		db_subscription(const db_subscription&) = delete;
+		db_subscription& operator=(const db_subscription&) = delete;
+		db_subscription(db_subscription&&) = default;
+		db_subscription& operator=(db_subscription&&) = default;
+		~db_subscription();
+		const std::string& channel() const { return channel_; }
+	};
+
+	// holds one dedicated connection in LISTEN mode and forwards
+	// the payload of each NOTIFY to the websocket sessions
+	// subscribed to the channel.
+	// the connection socket is waited on by the `io_context`,
+	// so no thread is blocked while there is no notification.
+	// the calls of pqxx, which block on the database (connecting, LISTEN,
+	// UNLISTEN and reading the notifications), are made on a worker
+	// thread, and their results are handled on `strand_`.
+	// the subscribers are accessed on `strand_` only.
+	class db_listener
+		: public std::enable_shared_from_this<db_listener> {
+	private:
+#ifdef _MSC_VER
+		using socket_type = asio::ip::tcp::socket;
+#else
+		using socket_type = asio::posix::stream_descriptor;
+#endif
+		// the channel and the payload of a notification
+		using notification_type = std::pair<std::string, std::string>;
+		class receiver : public pqxx::notification_receiver {
+		private:
+			db_listener& listener_;
+		public:
+			receiver(db_listener& listener, pqxx::connection& conn,
+				const std::string& channel)
+				: pqxx::notification_receiver{ conn, channel },
+				listener_{ listener } {}
+			void operator()(const std::string& payload, int backend_pid) override;
+		};
+		struct channel_type {
+			// LISTEN has been issued on the current connection
+			bool listening_ = false;
+			std::map<std::size_t, std::weak_ptr<websocket_session>> subscribers_;
+		};
+		friend class db_subscription;
+		// the following are accessed on `strand_` only
+		asio::strand<asio::io_context::executor_type> strand_;
+		socket_type socket_;
+		asio::steady_timer timer_;
+		const std::string conn_str_;
+		std::map<std::string, channel_type> channels_;
+		std::atomic<std::size_t> next_id_;
+		std::chrono::milliseconds backoff_;
+		bool connecting_;
+		bool connected_;
+		bool stopped_;
+		// the following are accessed on `worker_` only
+		asio::io_context worker_context_;
+		asio::executor_work_guard<asio::io_context::executor_type> worker_guard_;
+		std::unique_ptr<pqxx::connection> conn_;
+		std::map<std::string, std::unique_ptr<receiver>> receivers_;
+		std::vector<notification_type> received_;
+		std::thread worker_;
+		// runs `work` on the worker thread, then `done` on the strand
+		// with its result, or `std::nullopt` if it threw.
+		template <typename Work, typename Done>
+		void run_blocking(const char* operation, Work work, Done done);
+		// reads the notifications received by the connection, on the worker thread
+		std::vector<notification_type> take_received();
+		void connect();
+		void disconnect();
+		void on_failed();
+		void reconnect_later();
+		void do_wait();
+		void on_wait(const boost::system::error_code& ec);
+		void on_received(std::optional<std::vector<notification_type>> received);
+		void listen(const std::string& channel, channel_type& ch);
+		void unlisten(const std::string& channel);
+		void notify(const std::string& channel, const std::string& payload);
+		void unsubscribe(const std::string& channel, std::size_t id);
+	public:
+		// the connection is established on the first subscription
+		db_listener(asio::io_context& ioc, const std::string& conn_str);
+		db_listener(const db_listener&) = delete;
+		db_listener& operator=(const db_listener&) = delete;
+		~db_listener();
+		// the payloads of the notifications on `channel` will be
+		// written to `session` as text messages until the returned
+		// subscription is destroyed or the session is closed.
+		// it can be called from any thread.
+		db_subscription subscribe(
+			const std::string& channel,
+			std::shared_ptr<websocket_session> session);
+		// closes the connection, no notification will be forwarded after this.
+		void stop();
+	};
+
+}  // bserv
+
+#endif  // _NOTIFICATION_HPP
@@ -0,0 +1,88 @@
+#ifndef _PARAMS_HPP
+#define _PARAMS_HPP
+
+#include <boost/json.hpp>
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <optional>
+#include <functional>
+#include <utility>
+
+#include "client.hpp"
+#include "stream.hpp"
+
+namespace bserv {
+
+	class bad_request_exception : public std::exception {
+	private:
+		const std::string msg_;
+	public:
+		bad_request_exception()
+			: msg_{ "Request body is not a valid JSON string." } {}
+		bad_request_exception(const std::string& msg) : msg_{ msg } {}
+		const char* what() const noexcept { return msg_.c_str(); }
+	};
+
+	// a lazy view of the parameters of a request: the body (json,
+	// `application/x-www-form-urlencoded` or `multipart/form-data`)
+	// and the query string, in this order of precedence.
+	// nothing is parsed until a parameter is accessed:
+	// - the first key of a json body is found by a SAX pass, which builds
+	//   only its value (the other values are skipped without being
+	//   allocated), and the value is cached. another key builds the
+	//   object, since each pass goes through the whole body. the last
+	//   of the duplicate keys is used either way;
+	// - the query string is parsed only if there is a `?` in the target;
+	// - the object of all the parameters (the same as `json_params`)
+	//   is built only by `object`, and later accesses use it.
+	// `bad_request_exception` is thrown if the body is malformed.
+	class request_params {
+	private:
+		enum class body_kind {
+			none,
+			json,
+			form
+		};
+		const request_type& request_;
+		request_body_reader* body_reader_;
+		body_kind kind_;
+		// the fields of a body other than json
+		std::optional<boost::json::object> form_;
+		std::optional<boost::json::object> query_;
+		// the key of the json body looked up by the SAX pass,
+		// and its value, `std::nullopt` if missing
+		std::optional<std::pair<std::string, std::optional<boost::json::value>>> found_;
+		std::optional<boost::json::object> object_;
+		const boost::json::object& form();
+		const boost::json::object& query();
+		const boost::json::value* find_in_body(std::string_view key);
+		boost::json::object parse_body();
+	public:
+		// the body is read from `body_reader` on a streaming route
+		request_params(
+			const request_type& request,
+			request_body_reader* body_reader = nullptr);
+		request_params(const request_params&) = delete;
+		request_params& operator=(const request_params&) = delete;
+		bool is_json() const { return kind_ == body_kind::json; }
+		// `nullptr` if there is no such parameter
+		const boost::json::value* find(std::string_view key);
+		// looks up the query string only
+		const boost::json::value* find_in_query(std::string_view key);
+		bool contains(std::string_view key) { return find(key) != nullptr; }
+		// the value of `key` if it is a string, or `default_value`.
+		// the returned view is valid as long as this object.
+		std::string_view get_string(
+			std::string_view key, std::string_view default_value = {});
+		// all the parameters
+		boost::json::object& object();
+		// moves the object of all the parameters out,
+		// the parameters cannot be accessed after this.
+		boost::json::object release();
+	};
+
+}  // bserv
+
+#endif  // _PARAMS_HPP
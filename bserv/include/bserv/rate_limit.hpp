@@ -0,0 +1,82 @@
+#ifndef _RATE_LIMIT_HPP
+#define _RATE_LIMIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "config.hpp"
+
+namespace bserv {
+
+	// what the requests to a rate limited route are counted by
+	enum class rate_limit_key {
+		// the address of the client
+		ip,
+		// the session of the client if the cookie refers to an existing
+		// session, otherwise the address of the client (so that a client
+		// cannot get a new bucket by making up a cookie)
+		session,
+		// all the requests to the route share one bucket
+		route
+	};
+
+	// the request is rejected by the rate limit of the route,
+	// it is answered with `429 Too Many Requests`
+	class too_many_requests_exception
+		: public std::exception {
+	public:
+		too_many_requests_exception() = default;
+		const char* what() const noexcept { return "too many requests"; }
+	};
+
+	// a token bucket for each key, which holds up to `burst` tokens
+	// and is refilled with `rate` tokens per second, a request takes a token.
+	// a bucket is a single atomic: the time at which it would be full
+	// again, so the refill is computed lazily when it is checked,
+	// and the check is a compare-and-swap (no lock is held on it).
+	// the buckets are split into `RATE_LIMIT_SHARDS` shards by the hash
+	// of the key, and the lock of a shard is only taken exclusively when
+	// a key is seen for the first time (or again after its bucket was full).
+	// a shard holds at most `RATE_LIMIT_SHARD_BUCKETS` buckets: at the cap,
+	// the full buckets are dropped, then the ones closest to full down to
+	// half of the cap.
+	class rate_limiter {
+	private:
+		struct bucket {
+			// the time at which the bucket is full, in nanoseconds of `steady_clock`
+			std::atomic<std::int64_t> full_at;
+		};
+		struct shard {
+			mutable std::shared_mutex lock;
+			std::unordered_map<std::string, std::unique_ptr<bucket>> buckets;
+		};
+		// the time to refill a token
+		const std::int64_t interval_;
+		// the time to refill the bucket from empty
+		const std::int64_t capacity_;
+		std::array<shard, RATE_LIMIT_SHARDS> shards_;
+		std::atomic<std::size_t> rejected_;
+		bool take(bucket& b, std::int64_t now);
+		// called with the lock of `s` held exclusively
+		void evict(shard& s, std::int64_t now);
+	public:
+		// `rate` is in tokens per second, `burst` is at least 1.
+		rate_limiter(double rate, double burst);
+		rate_limiter(const rate_limiter&) = delete;
+		rate_limiter& operator=(const rate_limiter&) = delete;
+		// returns false if the bucket of `key` is empty
+		bool try_acquire(const std::string& key);
+		// the number of requests rejected
+		std::size_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+	};
+
+}  // bserv
+
+#endif  // _RATE_LIMIT_HPP
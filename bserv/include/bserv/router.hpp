@@ -6,6 +6,7 @@
 #include <boost/beast.hpp>
 #include <boost/json.hpp>
 
+#include <cstdint>
 #include <string>
 #include <regex>
 #include <vector>
@@ -22,6 +23,13 @@
 #include "utils.hpp"
 #include "config.hpp"
 #include "websocket.hpp"
+#include "admission.hpp"
+#include "rate_limit.hpp"
+#include "notification.hpp"
+#include "stream.hpp"
+#include "multipart.hpp"
+#include "params.hpp"
+#include "binding.hpp"
 #include "logging.hpp"
 
 namespace bserv {
@@ -32,6 +40,11 @@ namespace bserv {
 	struct server_resources {
 		std::shared_ptr<session_manager_base> session_mgr;
 		std::shared_ptr<db_connection_manager> db_conn_mgr;
+		std::shared_ptr<db_listener> db_listener_ptr;
+		std::shared_ptr<websocket_limiter> websocket_limiter_ptr;
+		std::shared_ptr<admission_controller> admission_controller_ptr;
+		int compression_level = COMPRESSION_LEVEL;
+		std::size_t compression_threshold = COMPRESSION_THRESHOLD;
 	};
 
 	struct request_resources {
@@ -40,14 +53,20 @@ namespace bserv {
 		asio::io_context& ioc;
 		asio::yield_context& yield;
 		std::shared_ptr<websocket_session> ws_session;
+		// `nullptr` for websocket routes
+		response_writer* writer;
+		// `nullptr` unless the route is streaming
+		request_body_reader* body_reader;
 		const std::vector<std::string>& url_params;
 		request_type& request;
 		response_type& response;
 
 		std::shared_ptr<session_type> session_ptr;
 		std::shared_ptr<db_connection> db_connection_ptr;
+		std::shared_ptr<db_connection> db_read_connection_ptr;
 		std::shared_ptr<http_client> http_client_ptr;
 		std::shared_ptr<websocket_server> websocket_server_ptr;
+		std::optional<request_params> params;
 	};
 
 	namespace placeholders {
@@ -83,13 +102,58 @@ namespace bserv {
 		constexpr placeholder<-6> http_client_ptr;
 		// std::shared_ptr<bserv::websocket_server>
 		constexpr placeholder<-7> websocket_server_ptr;
+		// std::shared_ptr<bserv::db_connection>
+		// for read-only transactions, it is connected to a read replica
+		// if there is any available.
+		constexpr placeholder<-8> db_read_connection_ptr;
+		// std::shared_ptr<bserv::db_listener>
+		constexpr placeholder<-9> db_listener_ptr;
+		// std::shared_ptr<bserv::websocket_limiter>
+		// for reading the counters of the websocket sessions
+		constexpr placeholder<-10> websocket_limiter_ptr;
+		// bserv::response_writer&
+		// for streaming the body of the response, not for websocket routes
+		constexpr placeholder<-11> response_writer;
+		// bserv::request_body_reader&
+		// for reading the body of the request, only for streaming routes
+		// (see `path_holder::streaming`)
+		constexpr placeholder<-12> request_body;
+		// bserv::request_params&
+		// parses the parameters lazily, unlike `json_params`
+		constexpr placeholder<-13> params;
+		// std::shared_ptr<bserv::admission_controller>
+		// for reading the counters of the admission control
+		constexpr placeholder<-14> admission_controller_ptr;
+
+		template <typename T>
+		struct params_as_t {};
+		// T, a struct declared with `BSERV_PARAMS_FIELDS`
+		// the parameters are bound to its fields (see `bind_params`),
+		// and the request is rejected with 400 if any field is invalid.
+		template <typename T>
+		constexpr params_as_t<T> params_as{};
 
 	}  // placeholders
 
-	class bad_request_exception : public std::exception {
-	public:
-		bad_request_exception() = default;
-		const char* what() const noexcept { return "bad request"; }
+	// the options of a route, set with the setters of `path_holder`
+	struct route_options {
+		// permessage-deflate of the websocket routes
+		bool deflate = false;
+		int deflate_window_bits = WEBSOCKET_DEFLATE_WINDOW_BITS;
+		int deflate_mem_level = WEBSOCKET_DEFLATE_MEM_LEVEL;
+		std::size_t deflate_threshold = WEBSOCKET_DEFLATE_THRESHOLD;
+		// the codec of the websocket routes
+		message_codec codec = message_codec::json;
+		// the request body of an http route is read by the handler
+		// through `request_body_reader` instead of before routing
+		bool streaming = false;
+		// `PAYLOAD_LIMIT` (or `STREAMING_PAYLOAD_LIMIT` for a streaming
+		// route) if it is not set
+		std::optional<std::uint64_t> body_limit;
+		// the requests to the route are rejected with 429
+		// when the bucket of their key is empty
+		std::shared_ptr<rate_limiter> limiter;
+		rate_limit_key limit_by = rate_limit_key::ip;
 	};
 
 	namespace router_internal {
@@ -200,61 +264,10 @@ namespace bserv {
 		inline boost::json::object get_parameter_data(
 			request_resources& resources,
 			placeholders::placeholder<-4>) {
-			boost::json::object body;
-			auto add_to_body = [&body](
-				const std::map<std::string, std::string>& dict_param,
-				const std::map<std::string, std::vector<std::string>>& list_param) {
-					for (auto& [k, v] : dict_param) {
-						if (!body.contains(k)) {
-							body[k] = v;
-						}
-					}
-					for (auto& [k, vs] : list_param) {
-						if (!body.contains(k)) {
-							boost::json::array a;
-							for (auto& v : vs) {
-								a.push_back(boost::json::string{ v });
-							}
-							body[k] = a;
-						}
-					}
-			};
-			if (!resources.request.body().empty()) {
-				auto& content_type = resources.request[http::field::content_type];
-				/*
-					for reference:
-					Content-Type: text/html; charset=UTF-8
-					Content-Type: multipart/form-data; boundary=something
-				*/
-				std::string media_type;
-				for (auto& c : content_type) {
-					if (c == ' ') {
-						continue;
-					}
-					else if (c == ';') {
-						break;
-					}
-					media_type += c;
-				}
-				if (media_type == "application/json") {
-					try {
-						body = boost::json::parse(resources.request.body()).as_object();
-					}
-					catch (const std::exception& /*e*/) {
-						throw bad_request_exception{};
-					}
-				}
-				else if (media_type == "application/x-www-form-urlencoded") {
-					std::string copied_body{ resources.request.body() };
-					auto&& [dict_params, list_params] = utils::parse_params(copied_body);
-					add_to_body(dict_params, list_params);
-				}
-			}
-			std::string target{ resources.request.target() };
-			auto&& [url, dict_params, list_params] = utils::parse_url(target);
-			boost::ignore_unused(url);
-			add_to_body(dict_params, list_params);
-			return body;
+			// the body of a streaming route is read here only if it is
+			// a form or json, the file parts of a form are spooled to disk
+			request_params params{ resources.request, resources.body_reader };
+			return params.release();
 		}
 
 		inline std::shared_ptr<db_connection> get_parameter_data(
@@ -280,10 +293,70 @@ namespace bserv {
 			placeholders::placeholder<-7>) {
 			if (resources.websocket_server_ptr == nullptr)
 				resources.websocket_server_ptr =
-				std::make_shared<websocket_server>(*resources.ws_session, resources.yield);
+				std::make_shared<websocket_server>(resources.ws_session, resources.yield);
 			return resources.websocket_server_ptr;
 		}
 
+		inline std::shared_ptr<db_connection> get_parameter_data(
+			request_resources& resources,
+			placeholders::placeholder<-8>) {
+			if (resources.db_read_connection_ptr == nullptr)
+				resources.db_read_connection_ptr =
+				resources.resources.db_conn_mgr->get_read_or_block();
+			return resources.db_read_connection_ptr;
+		}
+
+		inline std::shared_ptr<db_listener> get_parameter_data(
+			request_resources& resources,
+			placeholders::placeholder<-9>) {
+			return resources.resources.db_listener_ptr;
+		}
+
+		inline std::shared_ptr<websocket_limiter> get_parameter_data(
+			request_resources& resources,
+			placeholders::placeholder<-10>) {
+			return resources.resources.websocket_limiter_ptr;
+		}
+
+		inline std::shared_ptr<admission_controller> get_parameter_data(
+			request_resources& resources,
+			placeholders::placeholder<-14>) {
+			return resources.resources.admission_controller_ptr;
+		}
+
+		inline response_writer& get_parameter_data(
+			request_resources& resources,
+			placeholders::placeholder<-11>) {
+			if (resources.writer == nullptr)
+				throw invalid_operation_exception{ "response_writer is not available for websocket routes" };
+			return *resources.writer;
+		}
+
+		inline request_body_reader& get_parameter_data(
+			request_resources& resources,
+			placeholders::placeholder<-12>) {
+			if (resources.body_reader == nullptr)
+				throw invalid_operation_exception{ "request_body is only available for streaming routes" };
+			return *resources.body_reader;
+		}
+
+		inline request_params& get_parameter_data(
+			request_resources& resources,
+			placeholders::placeholder<-13>) {
+			if (!resources.params.has_value())
+				resources.params.emplace(resources.request, resources.body_reader);
+			return resources.params.value();
+		}
+
+		template <typename T>
+		T get_parameter_data(
+			request_resources& resources,
+			placeholders::params_as_t<T>) {
+			auto result = bind_params<T>(resources.request, resources.body_reader);
+			if (!result.ok()) throw bad_request_exception{ result.message() };
+			return std::move(result.value);
+		}
+
 		template <int Idx, typename Func, typename Params, typename ...Args>
 		struct path_handler;
 
@@ -345,6 +418,9 @@ namespace bserv {
 		}
 
 		struct path_holder : std::enable_shared_from_this<path_holder> {
+		protected:
+			route_options options_;
+		public:
 			path_holder() = default;
 			virtual ~path_holder() = default;
 			virtual bool match(
@@ -352,8 +428,80 @@ namespace bserv {
 				std::vector<std::string>&) const = 0;
 			virtual std::optional<boost::json::value> invoke(
 				request_resources&) = 0;
+			const route_options& options() const { return options_; }
+			// enables permessage-deflate for a websocket route
+			// if the client supports it. the memory used by the compressor
+			// of each session is about `(1 << (window_bits + 2)) + (1 << (mem_level + 9))`
+			// bytes, `window_bits` is in [9, 15] and `mem_level` in [1, 9].
+			// a message smaller than `threshold` bytes is not compressed.
+			std::shared_ptr<path_holder> deflate(
+				int window_bits = WEBSOCKET_DEFLATE_WINDOW_BITS,
+				int mem_level = WEBSOCKET_DEFLATE_MEM_LEVEL,
+				std::size_t threshold = WEBSOCKET_DEFLATE_THRESHOLD) {
+				options_.deflate = true;
+				options_.deflate_window_bits = window_bits;
+				options_.deflate_mem_level = mem_level;
+				options_.deflate_threshold = threshold;
+				return shared_from_this();
+			}
+			// sets the codec of `websocket_server::write_json` for a websocket route,
+			// `read_json` decodes according to the type of the frame.
+			std::shared_ptr<path_holder> codec(message_codec codec) {
+				options_.codec = codec;
+				return shared_from_this();
+			}
+			// routes the request as soon as its header is received,
+			// and the handler reads the body (see `request_body_reader`).
+			std::shared_ptr<path_holder> streaming() {
+				options_.streaming = true;
+				return shared_from_this();
+			}
+			// a request with a larger body is answered with `413 Payload Too Large`.
+			std::shared_ptr<path_holder> body_limit(std::uint64_t limit) {
+				options_.body_limit = limit;
+				return shared_from_this();
+			}
+			// allows `rate` requests per second for each `key`,
+			// with bursts of up to `burst` requests (see `rate_limiter`).
+			// the limit is checked before the parameters are resolved.
+			std::shared_ptr<path_holder> rate_limit(
+				double rate, double burst,
+				rate_limit_key key = rate_limit_key::ip) {
+				options_.limiter = std::make_shared<rate_limiter>(rate, burst);
+				options_.limit_by = key;
+				return shared_from_this();
+			}
 		};
 
+		// the key of the bucket of a request, `address` is "ip:port"
+		inline std::string get_rate_limit_key(
+			rate_limit_key by, const std::string& address,
+			const request_type& request, session_manager_base& session_mgr) {
+			if (by == rate_limit_key::route) return {};
+			if (by == rate_limit_key::session) {
+				beast::string_view cookies = request[http::field::cookie];
+				std::size_t pos = 0;
+				while (pos < cookies.size()) {
+					std::size_t end = cookies.find(';', pos);
+					if (end == beast::string_view::npos) end = cookies.size();
+					beast::string_view cookie = cookies.substr(pos, end - pos);
+					while (!cookie.empty() && cookie.front() == ' ')
+						cookie.remove_prefix(1);
+					if (cookie.size() > SESSION_NAME.size()
+						&& cookie.starts_with(SESSION_NAME)
+						&& cookie[SESSION_NAME.size()] == '=') {
+						std::string key{ cookie.substr(SESSION_NAME.size() + 1) };
+						std::shared_ptr<session_type> session_ptr;
+						if (session_mgr.try_get(key, session_ptr))
+							return "session:" + key;
+						break;
+					}
+					pos = end + 1;
+				}
+			}
+			return address.substr(0, address.rfind(':'));
+		}
+
 		template <typename Func, typename Params>
 		class path;
 
@@ -362,14 +510,26 @@ namespace bserv {
 			: public path_holder {
 		private:
 			std::regex re_;
+			// a url without parameters (or any regex) is compared as is,
+			// without the allocations of `std::regex_match`
+			std::optional<std::string> literal_;
 			Ret(*pf_)(Args ...);
 			parameter_pack<Params...> params_;
 			path_handler<0, Ret(*)(Args ...), parameter_pack<Params...>, Params...> handler_;
 		public:
 			path(const std::string& url, Ret(*pf)(Args ...), Params&& ...params)
 				: re_{ get_re_url(url) }, pf_{ pf },
-				params_{ static_cast<Params&&>(params)... } {}
+				params_{ static_cast<Params&&>(params)... } {
+				if (url.find_first_of("<>\\^$.|?*+()[]{}") == std::string::npos)
+					literal_ = url;
+			}
 			bool match(const std::string& url, std::vector<std::string>& result) const {
+				if (literal_.has_value()) {
+					if (url != literal_.value()) return false;
+					// there is no parameter to be referred to
+					result.clear();
+					return true;
+				}
 				std::smatch r;
 				bool matched = std::regex_match(url, r, re_);
 				if (matched) {
@@ -419,26 +579,58 @@ namespace bserv {
 		using path_holder_type = std::shared_ptr<router_internal::path_holder>;
 		std::vector<path_holder_type> paths_;
 		std::shared_ptr<server_resources> resources_;
+		bool has_streaming_routes_;
 	public:
 		router(const std::initializer_list<path_holder_type>& paths)
-			: paths_{ paths } {}
+			: paths_{ paths }, has_streaming_routes_{ false } {
+			for (auto& ptr : paths_)
+				if (ptr->options().streaming)
+					has_streaming_routes_ = true;
+		}
 		void set_resources(std::shared_ptr<server_resources> resources) {
 			resources_ = resources;
 		}
+		const server_resources& resources() const { return *resources_; }
+		// a request without a body is routed without
+		// looking up the options if it is false
+		bool has_streaming_routes() const { return has_streaming_routes_; }
+		// the options of the route matching `url`,
+		// or `nullptr` if there is no such route
+		const route_options* find_options(const std::string& url) const {
+			std::vector<std::string> url_params;
+			for (auto& ptr : paths_)
+				if (ptr->match(url, url_params))
+					return &ptr->options();
+			return nullptr;
+		}
 		std::optional<boost::json::value> operator()(
 			asio::io_context& ioc, asio::yield_context& yield,
 			std::shared_ptr<websocket_session> ws_session,
+			response_writer* writer,
+			request_body_reader* body_reader,
+			const std::string& address,
 			const std::string& url, request_type& request, response_type& response) {
 			std::vector<std::string> url_params;
 			for (auto& ptr : paths_) {
 				if (ptr->match(url, url_params)) {
 					lgtrace << "router: received request: " << url;
+					const route_options& options = ptr->options();
+					if (options.limiter != nullptr
+						&& !options.limiter->try_acquire(
+							router_internal::get_rate_limit_key(
+								options.limit_by, address, request,
+								*resources_->session_mgr))) {
+						lgdebug << "router: rate limited: " << address << " " << url;
+						throw too_many_requests_exception{};
+					}
 					request_resources resources{
 						*resources_,
 
 						ioc,
 						yield,
 						ws_session,
+						writer,
+						body_reader,
 						url_params,
 						request,
 						response,
@@ -446,6 +638,7 @@ namespace bserv {
 						nullptr,
 						nullptr,
 						nullptr,
+						nullptr,
 						nullptr
 					};
 					return ptr->invoke(resources);
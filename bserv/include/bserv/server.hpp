@@ -26,6 +26,7 @@
 #include "router.hpp"
 #include "database.hpp"
 #include "session.hpp"
+#include "notification.hpp"
 
 namespace bserv {
 
@@ -44,6 +45,9 @@ namespace bserv {
 		router ws_routes_;
 		std::shared_ptr<session_manager_base> session_mgr_;
 		std::shared_ptr<db_connection_manager> db_conn_mgr_;
+		std::shared_ptr<db_listener> db_listener_;
+		std::shared_ptr<websocket_limiter> ws_limiter_;
+		std::shared_ptr<admission_controller> admission_;
 	public:
 		server(const server_config& config, router&& routes, router&& ws_routes = {});
 	};
@@ -0,0 +1,198 @@
+#ifndef _STREAM_HPP
+#define _STREAM_HPP
+
+#include <boost/asio/spawn.hpp>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <optional>
+#include <vector>
+#include <exception>
+#include <functional>
+
+#include "client.hpp"
+
+namespace bserv {
+
+	namespace asio = boost::asio;
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
+	// the client is gone while the response is being streamed
+	class response_stream_closed
+		: public std::exception {
+	public:
+		response_stream_closed() = default;
+		const char* what() const noexcept { return "response stream closed"; }
+	};
+
+	// the client is gone while the request body is being read
+	class request_stream_closed
+		: public std::exception {
+	public:
+		request_stream_closed() = default;
+		const char* what() const noexcept { return "request stream closed"; }
+	};
+
+	// the request body exceeds the limit of the route
+	class payload_too_large_exception
+		: public std::exception {
+	public:
+		payload_too_large_exception() = default;
+		const char* what() const noexcept { return "payload too large"; }
+	};
+
+	// reads the body of a request on a streaming route (see
+	// `path_holder::streaming`) as the handler consumes it,
+	// so that a large upload is not buffered in memory.
+	// `100 Continue` is sent before the first read if the client
+	// expects it, so a handler can reject a request without
+	// receiving its body.
+	// Usage:
+	//   std::nullopt_t handler(bserv::request_body_reader& body, ...) {
+	//       char buffer[4096];
+	//       while (std::size_t n = body.read_some(buffer, sizeof(buffer))) ...
+	//       return std::nullopt;
+	//   }
+	// the connection is closed after the response
+	// if the body is not read to the end.
+	class request_body_reader {
+	private:
+		beast::tcp_stream& stream_;
+		beast::flat_buffer& buffer_;
+		http::request_parser<http::buffer_body, pool_allocator<char>>& parser_;
+		asio::yield_context& yield_;
+		bool continued_;
+		bool failed_;
+		// the temporary files created by `spool` and `temp_file_path`
+		std::vector<std::string> spooled_;
+		void send_continue();
+	public:
+		request_body_reader(
+			beast::tcp_stream& stream,
+			beast::flat_buffer& buffer,
+			http::request_parser<http::buffer_body, pool_allocator<char>>& parser,
+			asio::yield_context& yield)
+			: stream_{ stream }, buffer_{ buffer },
+			parser_{ parser }, yield_{ yield },
+			continued_{ false }, failed_{ false } {}
+		request_body_reader(const request_body_reader&) = delete;
+		request_body_reader& operator=(const request_body_reader&) = delete;
+		// removes the temporary files
+		~request_body_reader();
+		// reads at most `size` bytes of the body into `data`,
+		// it returns only when `data` is full or the body ends.
+		// returns the number of bytes read, 0 at the end of the body.
+		// throws `payload_too_large_exception` if the body exceeds the limit,
+		// `request_stream_closed` if the client is gone.
+		std::size_t read_some(char* data, std::size_t size);
+		// reads the rest of the body.
+		std::string read_all();
+		// writes the rest of the body to `path`,
+		// returns the number of bytes written.
+		std::uint64_t save_to(const std::string& path);
+		// writes the rest of the body to a temporary file,
+		// which is removed when the reader is destroyed.
+		// returns the path of the file.
+		std::string spool();
+		// a unique path in the temporary directory,
+		// the file is removed when the reader is destroyed.
+		std::string temp_file_path();
+		// the header of the request
+		const http::request_parser<http::buffer_body, pool_allocator<char>>::value_type& header() const { return parser_.get(); }
+		std::optional<std::uint64_t> content_length() const;
+		bool done() const { return parser_.is_done(); }
+		bool failed() const { return failed_; }
+	};
+
+	// writes the body of a response with chunked transfer encoding,
+	// so that a handler can send the body as it is produced instead of
+	// building it in `response.body()`.
+	// the status and the fields are taken from the `response` of the
+	// request, the body of which is ignored once the header is sent.
+	// Usage:
+	//   std::nullopt_t handler(bserv::response_writer& writer, ...) {
+	//       for (...) writer.write(chunk);
+	//       return std::nullopt;
+	//   }
+	// the response is finished after the handler returns if the
+	// handler does not finish it, so the return value is not sent.
+	class response_writer {
+	private:
+		beast::tcp_stream& stream_;
+		const request_type& request_;
+		response_type& response_;
+		asio::yield_context& yield_;
+		bool started_;
+		bool finished_;
+		bool failed_;
+		std::function<void()> on_start_;
+		void set_started();
+		template <typename Buffers>
+		void do_write(const Buffers& buffers);
+	public:
+		response_writer(
+			beast::tcp_stream& stream,
+			const request_type& request,
+			response_type& response,
+			asio::yield_context& yield)
+			: stream_{ stream }, request_{ request },
+			response_{ response }, yield_{ yield },
+			started_{ false }, finished_{ false }, failed_{ false } {}
+		response_writer(const response_writer&) = delete;
+		response_writer& operator=(const response_writer&) = delete;
+		// sends the header of the response,
+		// it is called by the first `write` if not called.
+		void start();
+		// sends `chunk` as one chunk, an empty chunk is skipped.
+		// nothing is sent after the header for a HEAD request.
+		// `response_stream_closed` is thrown if the client is gone.
+		void write(std::string_view chunk);
+		// sends the last chunk.
+		void finish();
+		// sends the whole response with `Content-Length` instead of
+		// chunks, `body` is written without being copied.
+		// it should be called before the header is sent.
+		void write_body(std::string_view body);
+		// `callback` is called once when the header is about to be sent
+		void on_start(std::function<void()> callback) { on_start_ = std::move(callback); }
+		bool started() const { return started_; }
+		bool finished() const { return finished_; }
+		bool failed() const { return failed_; }
+		// whether the connection should be closed after the response
+		bool need_eof() const { return failed_ || !response_.keep_alive(); }
+		// for waiting on other operations between the chunks
+		asio::yield_context& yield() { return yield_; }
+		response_type& response() { return response_; }
+	};
+
+	// writes server-sent events (`text/event-stream`) on top of
+	// a `response_writer`, each event is sent as one chunk.
+	// the header is sent when it is constructed.
+	class sse_writer {
+	private:
+		response_writer& writer_;
+	public:
+		explicit sse_writer(response_writer& writer);
+		// sends an event, the lines of `data` are sent as
+		// separate `data:` fields and joined by the client.
+		void send(
+			std::string_view data,
+			std::string_view event = {},
+			std::string_view id = {});
+		// sends a comment, which is ignored by the client,
+		// to keep the connection alive.
+		void comment(std::string_view text = {});
+		// sets the reconnection delay of the client.
+		void retry(std::chrono::milliseconds delay);
+		void finish() { writer_.finish(); }
+	};
+
+}  // bserv
+
+#endif  // _STREAM_HPP
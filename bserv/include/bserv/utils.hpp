@@ -8,8 +8,16 @@
 #include <map>
 #include <random>
 #include <optional>
+#include <string_view>
 
 #include "client.hpp"
+#include "config.hpp"
+
+namespace bserv {
+
+	class response_writer;
+
+}  // bserv
 
 namespace bserv::utils {
 
@@ -60,6 +68,41 @@ namespace bserv::utils {
 		std::map<std::string, std::vector<std::string>>>
 		parse_url(std::string& s);
 
+	namespace compression {
+
+		// the content codings supported in responses
+		enum class encoding {
+			identity,
+			gzip,
+			deflate
+		};
+
+		// chooses an encoding for the value of `Accept-Encoding`,
+		// gzip is preferred when both are acceptable.
+		encoding negotiate(boost::beast::string_view accept_encoding);
+
+		// whether a response of `content_type` is worth compressing
+		// (text, json, javascript, xml and svg).
+		bool compressible(boost::beast::string_view content_type);
+
+		// `level` is in [1, 9]
+		std::string gzip(std::string_view data, int level = COMPRESSION_LEVEL);
+
+		// the zlib format (RFC 1950), which is what "deflate" means in HTTP
+		std::string deflate(std::string_view data, int level = COMPRESSION_LEVEL);
+
+		// compresses the body of `response` with the encoding negotiated
+		// for `request`, if the content type is compressible and the body
+		// has at least `threshold` bytes. it does nothing if the response
+		// already has a Content-Encoding. `level` 0 disables it.
+		void compress_response(
+			const request_type& request,
+			response_type& response,
+			int level = COMPRESSION_LEVEL,
+			std::size_t threshold = COMPRESSION_THRESHOLD);
+
+	}  // compression
+
 	namespace file {
 
 		class file_not_found : public std::exception {
@@ -77,6 +120,22 @@ namespace bserv::utils {
 			response_type& response,
 			const std::string& filename);
 
+		// serves a gzip-compressed variant of the file if the client
+		// accepts it: `filename` + ".gz" if it exists, otherwise the file
+		// compressed once and cached in memory (up to `STATIC_GZIP_CACHE_SIZE`
+		// bytes, the least recently used is evicted) until it is modified.
+		std::nullopt_t serve(
+			const request_type& request,
+			response_type& response,
+			const std::string& filename);
+
+		// the same, but the compressed variant is written by `writer`
+		// from the buffer of the cache, instead of being copied to the body.
+		std::nullopt_t serve(
+			const request_type& request,
+			response_writer& writer,
+			const std::string& filename);
+
 	}  // file
 
 }  // bserv::utils
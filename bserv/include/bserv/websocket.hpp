@@ -3,12 +3,23 @@
 
 #include <boost/beast.hpp>
 #include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
 #include <boost/json.hpp>
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <cstddef>
 #include <cstdlib>
+#include <deque>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <chrono>
+
+#include "config.hpp"
+#include "msgpack.hpp"
+#include <memory>
 
 namespace bserv {
 
@@ -35,7 +46,59 @@ namespace bserv {
 		const char* what() const noexcept { return msg_.c_str(); }
 	};
 
-	struct websocket_session {
+	struct websocket_stats {
+		// the number of open sessions
+		std::size_t sessions;
+		// the number of upgrades rejected by the global cap
+		std::size_t rejected;
+		// the number of upgrades rejected by the per-ip cap
+		std::size_t rejected_per_ip;
+		// the number of sessions closed for being idle
+		std::size_t reaped;
+		// the number of sessions closed because the pings were not answered
+		std::size_t timed_out;
+	};
+
+	// caps the number of concurrent websocket sessions,
+	// globally and per client ip, and counts the sessions closed
+	// by the server.
+	class websocket_limiter {
+	private:
+		const std::size_t max_sessions_;
+		const std::size_t max_sessions_per_ip_;
+		const std::chrono::seconds ping_interval_;
+		const std::chrono::seconds idle_timeout_;
+		mutable std::mutex lock_;
+		std::map<std::string, std::size_t> sessions_per_ip_;
+		std::size_t sessions_;
+		std::size_t rejected_;
+		std::size_t rejected_per_ip_;
+		std::atomic<std::size_t> reaped_;
+		std::atomic<std::size_t> timed_out_;
+	public:
+		websocket_limiter(
+			std::size_t max_sessions = MAX_WEBSOCKET_SESSIONS,
+			std::size_t max_sessions_per_ip = MAX_WEBSOCKET_SESSIONS_PER_IP,
+			std::chrono::seconds ping_interval = std::chrono::seconds{ WEBSOCKET_PING_INTERVAL },
+			std::chrono::seconds idle_timeout = std::chrono::seconds{ WEBSOCKET_IDLE_TIMEOUT })
+			: max_sessions_{ max_sessions },
+			max_sessions_per_ip_{ max_sessions_per_ip },
+			ping_interval_{ ping_interval }, idle_timeout_{ idle_timeout },
+			sessions_{ 0 }, rejected_{ 0 }, rejected_per_ip_{ 0 },
+			reaped_{ 0 }, timed_out_{ 0 } {}
+		// returns false if either cap is reached,
+		// otherwise `release` should be called when the session is closed.
+		bool try_acquire(const std::string& ip);
+		void release(const std::string& ip);
+		void on_reaped() { ++reaped_; }
+		void on_timed_out() { ++timed_out_; }
+		std::chrono::seconds ping_interval() const { return ping_interval_; }
+		std::chrono::seconds idle_timeout() const { return idle_timeout_; }
+		websocket_stats stats() const;
+	};
+
+	struct websocket_session
+		: std::enable_shared_from_this<websocket_session> {
 		const std::string address_;
 		asio::io_context& ioc_;
 		websocket::stream<beast::tcp_stream> ws_;
@@ -44,20 +107,152 @@ namespace bserv {
 			asio::io_context& ioc,
 			tcp::socket&& socket)
 			: address_{ address },
-			ioc_{ ioc }, ws_{ std::move(socket) } {}
+			ioc_{ ioc }, ws_{ std::move(socket) },
+			codec_{ message_codec::json },
+			incoming_{ nullptr }, drain_scheduled_{ false },
+			queue_size_{ 0 }, bytes_buffered_{ 0 },
+			high_water_mark_{ WEBSOCKET_HIGH_WATER_MARK },
+			writing_{ false }, in_flight_{ 0 }, in_flight_bytes_{ 0 },
+			coalesce_limit_{ 0 }, writable_{ ws_.get_executor() },
+			idle_timer_{ ws_.get_executor() },
+			closing_{ false }, failed_{ false } {}
+		websocket_session(const websocket_session&) = delete;
+		websocket_session& operator=(const websocket_session&) = delete;
+		// releases the slot acquired from `limiter`
+		~websocket_session();
+		// the session counts against `limiter` until it is destroyed
+		void set_limiter(std::shared_ptr<websocket_limiter> limiter, const std::string& ip) {
+			limiter_ = limiter;
+			ip_ = ip;
+		}
+		// closes the session if no message is read or written
+		// for `idle_timeout`, it should be called on the strand of `ws_`.
+		void start_idle_timer(std::chrono::seconds idle_timeout);
+		// queues `message`, which will be written after all the messages
+		// queued before it. since only one write can be outstanding on a
+		// websocket stream, all the writes should go through this function.
+		// it can be called from any thread, and it does not block:
+		// the message is pushed to a lock-free list, which is moved
+		// to the write queue on the strand of `ws_`.
+		// it is written in a binary frame if `binary` is true.
+		void send(std::shared_ptr<const std::string> message, bool binary = false);
+		// closes the session after the message being written,
+		// the queued messages are discarded.
+		// it can be called from any thread.
+		void close(websocket::close_code code = websocket::close_code::normal);
+		// the number of messages queued but not written yet
+		std::size_t queue_size() const { return queue_size_.load(std::memory_order_relaxed); }
+		// the total size of the messages queued but not written yet
+		std::size_t bytes_buffered() const { return bytes_buffered_.load(std::memory_order_relaxed); }
+		std::size_t high_water_mark() const { return high_water_mark_.load(std::memory_order_relaxed); }
+		// when `bytes_buffered` reaches the high-water mark,
+		// `wait_writable` blocks the producer until it drops below half of it.
+		void set_high_water_mark(std::size_t bytes) { high_water_mark_ = bytes; }
+		bool writable() const { return bytes_buffered() < high_water_mark(); }
+		// waits until the session is writable or closed,
+		// it should be called on the strand of `ws_`.
+		void wait_writable(asio::yield_context& yield);
+		// if it is not 0, the queued messages are joined with '\n'
+		// and written in one message of at most `bytes` bytes
+		// (a message larger than this is written alone).
+		// the client should split the messages it receives on '\n'.
+		// only the text messages without '\n' are coalesced (e.g. the
+		// compact json of `write_json`), the others are written alone,
+		// so that the client can restore the original messages.
+		// it should be called on the strand of `ws_`.
+		void set_coalesce_limit(std::size_t bytes) { coalesce_limit_ = bytes; }
+		// the codec of `websocket_server::read_json` and `write_json`,
+		// it is set by the route (see `path_holder::codec`).
+		message_codec codec() const { return codec_; }
+		void set_codec(message_codec codec) { codec_ = codec; }
+		// whether a write has failed or the session is being closed
+		bool closed() const { return failed_.load(std::memory_order_relaxed); }
+	private:
+		friend class websocket_server;
+		// reused by all the reads
+		beast::flat_buffer read_buffer_;
+		// reused by `websocket_server::read_json`
+		boost::json::parser parser_;
+		message_codec codec_;
+		struct outbound {
+			std::shared_ptr<const std::string> data_;
+			bool binary_;
+		};
+		struct node {
+			outbound message_;
+			node* next_;
+		};
+		// the messages sent but not moved to `queue_` yet,
+		// in the reverse order
+		std::atomic<node*> incoming_;
+		std::atomic<bool> drain_scheduled_;
+		std::atomic<std::size_t> queue_size_;
+		std::atomic<std::size_t> bytes_buffered_;
+		std::atomic<std::size_t> high_water_mark_;
+		// the following are accessed on the strand of `ws_` only
+		std::deque<outbound> queue_;
+		bool writing_;
+		// the number and size of the messages being written
+		std::size_t in_flight_;
+		std::size_t in_flight_bytes_;
+		std::size_t coalesce_limit_;
+		// the buffer of the coalesced messages
+		std::string coalesced_;
+		// cancelled when the session becomes writable
+		asio::steady_timer writable_;
+		std::shared_ptr<websocket_limiter> limiter_;
+		std::string ip_;
+		asio::steady_timer idle_timer_;
+		std::chrono::seconds idle_timeout_;
+		// when a message was read or written last
+		std::chrono::steady_clock::time_point last_active_;
+		bool closing_;
+		websocket::close_code close_code_;
+		std::atomic<bool> failed_;
+		void drain();
+		void do_write();
+		void on_write(beast::error_code ec, std::size_t bytes_transferred);
+		// writes `data` without queuing it if nothing is queued or being
+		// written, and returns false otherwise. it should be called on
+		// the strand of `ws_`, and it waits until `data` is written.
+		bool write_direct(const std::string& data, bool binary, asio::yield_context& yield);
+		void do_close();
+		void discard_queue();
+		void notify_writable();
+		void do_idle_wait();
+		void on_idle(beast::error_code ec);
 	};
 
 	class websocket_server {
 	private:
-		websocket_session& session_;
+		std::shared_ptr<websocket_session> session_;
 		asio::yield_context& yield_;
+		// the buffer of `write_json`, reused by all the messages
+		std::string encoded_;
 	public:
-		websocket_server(websocket_session& session, asio::yield_context& yield)
+		websocket_server(std::shared_ptr<websocket_session> session, asio::yield_context& yield)
 			: session_{ session }, yield_{ yield } {}
-		std::string read();
-		boost::json::value read_json() { return boost::json::parse(read()); }
+		// the returned view refers to the read buffer of the session,
+		// it is valid until the next read.
+		std::string_view read_view();
+		std::string read() { return std::string{ read_view() }; }
+		// a binary message is decoded as MessagePack, and a text message as json.
+		// parses the message in place, the value is allocated from `sp`
+		// (e.g. a `boost::json::monotonic_resource` reused by the caller).
+		boost::json::value read_json(boost::json::storage_ptr sp = {});
+		// the message is queued (see `websocket_session::send`),
+		// this function does not wait for it to be written.
 		void write(const std::string& data);
-		void write_json(const boost::json::value& val) { write(boost::json::serialize(val)); }
+		void write_binary(const std::string& data);
+		// the value is written in a text frame of json,
+		// or in a binary frame of MessagePack, depending on the codec of the session.
+		// it is encoded into a buffer of the server, which is written
+		// directly (waiting for it to be written) if nothing is queued,
+		// and only copied into a shared frame if it has to be queued.
+		void write_json(const boost::json::value& val);
+		// whether the message read last is binary
+		bool got_binary() const { return session_->ws_.got_binary(); }
+		std::shared_ptr<websocket_session> session() const { return session_; }
 	};
 
 }  // bserv
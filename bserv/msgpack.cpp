@@ -0,0 +1,214 @@
+#include "pch.h"
+#include "bserv/msgpack.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace bserv::msgpack {
+
+    namespace {
+
+        // the maximum nesting of arrays and maps
+        const int MAX_DEPTH = 64;
+
+        // big-endian
+        template <typename Type>
+        void put(std::string& out, unsigned char tag, Type x) {
+            char buf[sizeof(Type) + 1];
+            buf[0] = (char)tag;
+            for (std::size_t i = 0; i < sizeof(Type); ++i)
+                buf[sizeof(Type) - i] = (char)((std::uint64_t)x >> (i * 8));
+            out.append(buf, sizeof(Type) + 1);
+        }
+
+        void put_unsigned(std::string& out, std::uint64_t x) {
+            if (x < 128) out += (char)x;
+            else if (x <= 0xff) put(out, 0xcc, (std::uint8_t)x);
+            else if (x <= 0xffff) put(out, 0xcd, (std::uint16_t)x);
+            else if (x <= 0xffffffff) put(out, 0xce, (std::uint32_t)x);
+            else put(out, 0xcf, x);
+        }
+
+        void put_signed(std::string& out, std::int64_t x) {
+            if (x >= 0) put_unsigned(out, (std::uint64_t)x);
+            else if (x >= -32) out += (char)(std::int8_t)x;
+            else if (x >= std::numeric_limits<std::int8_t>::min()) put(out, 0xd0, (std::uint8_t)x);
+            else if (x >= std::numeric_limits<std::int16_t>::min()) put(out, 0xd1, (std::uint16_t)x);
+            else if (x >= std::numeric_limits<std::int32_t>::min()) put(out, 0xd2, (std::uint32_t)x);
+            else put(out, 0xd3, (std::uint64_t)x);
+        }
+
+        // the header of a string, an array or a map
+        void put_size(std::string& out, std::size_t n,
+            unsigned char fix_tag, std::size_t fix_max,
+            unsigned char tag8, unsigned char tag16) {
+            if (n <= fix_max) out += (char)(fix_tag | n);
+            else if (tag8 != 0 && n <= 0xff) put(out, tag8, (std::uint8_t)n);
+            else if (n <= 0xffff) put(out, tag16, (std::uint16_t)n);
+            else put(out, tag16 + 1, (std::uint32_t)n);
+        }
+
+        void put_string(std::string& out, std::string_view s) {
+            put_size(out, s.size(), 0xa0, 31, 0xd9, 0xda);
+            out.append(s.data(), s.size());
+        }
+
+        class decoder {
+        private:
+            const unsigned char* p_;
+            const unsigned char* end_;
+            boost::json::storage_ptr sp_;
+            void need(std::size_t n) {
+                if ((std::size_t)(end_ - p_) < n)
+                    throw msgpack_error{ "msgpack: unexpected end of data" };
+            }
+            template <typename Type>
+            Type get() {
+                need(sizeof(Type));
+                std::uint64_t x = 0;
+                for (std::size_t i = 0; i < sizeof(Type); ++i)
+                    x = (x << 8) | p_[i];
+                p_ += sizeof(Type);
+                return (Type)x;
+            }
+            std::string_view get_bytes(std::size_t n) {
+                need(n);
+                std::string_view s{ (const char*)p_, n };
+                p_ += n;
+                return s;
+            }
+            template <typename Type>
+            boost::json::value make(Type x) {
+                return boost::json::value(x, sp_);
+            }
+            boost::json::value get_unsigned(std::uint64_t x) {
+                if (x <= (std::uint64_t)std::numeric_limits<std::int64_t>::max())
+                    return make((std::int64_t)x);
+                return make(x);
+            }
+            boost::json::value get_array(std::size_t n, int depth) {
+                boost::json::array arr(sp_);
+                // each element takes at least one byte
+                need(n);
+                arr.reserve(n);
+                for (std::size_t i = 0; i < n; ++i)
+                    arr.emplace_back(get_value(depth + 1));
+                return arr;
+            }
+            boost::json::value get_map(std::size_t n, int depth) {
+                boost::json::object obj(sp_);
+                need(2 * n);
+                obj.reserve(n);
+                for (std::size_t i = 0; i < n; ++i) {
+                    boost::json::value key = get_value(depth + 1);
+                    if (!key.is_string())
+                        throw msgpack_error{ "msgpack: the key of a map is not a string" };
+                    obj.insert_or_assign(key.as_string(), get_value(depth + 1));
+                }
+                return obj;
+            }
+        public:
+            decoder(std::string_view data, boost::json::storage_ptr sp)
+                : p_{ (const unsigned char*)data.data() },
+                end_{ (const unsigned char*)data.data() + data.size() },
+                sp_{ std::move(sp) } {}
+            bool done() const { return p_ == end_; }
+            boost::json::value get_value(int depth) {
+                if (depth > MAX_DEPTH)
+                    throw msgpack_error{ "msgpack: too deep" };
+                unsigned char tag = get<std::uint8_t>();
+                if (tag < 0x80) return make((std::int64_t)tag);
+                if (tag >= 0xe0) return make((std::int64_t)(std::int8_t)tag);
+                if ((tag & 0xf0) == 0x80) return get_map(tag & 0x0f, depth);
+                if ((tag & 0xf0) == 0x90) return get_array(tag & 0x0f, depth);
+                if ((tag & 0xe0) == 0xa0) return make(get_bytes(tag & 0x1f));
+                switch (tag) {
+                case 0xc0: return make(nullptr);
+                case 0xc2: return make(false);
+                case 0xc3: return make(true);
+                case 0xc4: case 0xd9: return make(get_bytes(get<std::uint8_t>()));
+                case 0xc5: case 0xda: return make(get_bytes(get<std::uint16_t>()));
+                case 0xc6: case 0xdb: return make(get_bytes(get<std::uint32_t>()));
+                case 0xca: {
+                    std::uint32_t bits = get<std::uint32_t>();
+                    float f;
+                    std::memcpy(&f, &bits, sizeof(f));
+                    return make((double)f);
+                }
+                case 0xcb: {
+                    std::uint64_t bits = get<std::uint64_t>();
+                    double d;
+                    std::memcpy(&d, &bits, sizeof(d));
+                    return make(d);
+                }
+                case 0xcc: return get_unsigned(get<std::uint8_t>());
+                case 0xcd: return get_unsigned(get<std::uint16_t>());
+                case 0xce: return get_unsigned(get<std::uint32_t>());
+                case 0xcf: return get_unsigned(get<std::uint64_t>());
+                case 0xd0: return make((std::int64_t)(std::int8_t)get<std::uint8_t>());
+                case 0xd1: return make((std::int64_t)(std::int16_t)get<std::uint16_t>());
+                case 0xd2: return make((std::int64_t)(std::int32_t)get<std::uint32_t>());
+                case 0xd3: return make((std::int64_t)get<std::uint64_t>());
+                case 0xdc: return get_array(get<std::uint16_t>(), depth);
+                case 0xdd: return get_array(get<std::uint32_t>(), depth);
+                case 0xde: return get_map(get<std::uint16_t>(), depth);
+                case 0xdf: return get_map(get<std::uint32_t>(), depth);
+                default:
+                    throw msgpack_error{ "msgpack: unsupported type" };
+                }
+            }
+        };
+
+    }  // namespace
+
+    void encode(const boost::json::value& val, std::string& out) {
+        switch (val.kind()) {
+        case boost::json::kind::null:
+            out += (char)0xc0;
+            break;
+        case boost::json::kind::bool_:
+            out += (char)(val.get_bool() ? 0xc3 : 0xc2);
+            break;
+        case boost::json::kind::int64:
+            put_signed(out, val.get_int64());
+            break;
+        case boost::json::kind::uint64:
+            put_unsigned(out, val.get_uint64());
+            break;
+        case boost::json::kind::double_: {
+            double d = val.get_double();
+            std::uint64_t bits;
+            std::memcpy(&bits, &d, sizeof(bits));
+            put(out, 0xcb, bits);
+            break;
+        }
+        case boost::json::kind::string:
+            put_string(out, val.get_string());
+            break;
+        case boost::json::kind::array: {
+            const auto& arr = val.get_array();
+            put_size(out, arr.size(), 0x90, 15, 0, 0xdc);
+            for (const auto& element : arr) encode(element, out);
+            break;
+        }
+        case boost::json::kind::object: {
+            const auto& obj = val.get_object();
+            put_size(out, obj.size(), 0x80, 15, 0, 0xde);
+            for (const auto& kv : obj) {
+                put_string(out, kv.key());
+                encode(kv.value(), out);
+            }
+            break;
+        }
+        }
+    }
+
+    boost::json::value decode(std::string_view data, boost::json::storage_ptr sp) {
+        decoder d{ data, std::move(sp) };
+        boost::json::value val = d.get_value(0);
+        if (!d.done()) throw msgpack_error{ "msgpack: trailing data" };
+        return val;
+    }
+
+}  // bserv::msgpack
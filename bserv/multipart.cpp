@@ -0,0 +1,369 @@
+#include "pch.h"
+#include "bserv/multipart.hpp"
+#include "bserv/config.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace bserv {
+
+    namespace {
+
+        // the maximum size of the headers of a part
+        const std::size_t HEADER_LIMIT = 8 * 1024;
+        // the maximum length of the transport padding after a delimiter
+        const std::size_t PADDING_LIMIT = 256;
+        // the size of the buffer used to read the body
+        const std::size_t READ_BUFFER_SIZE = 64 * 1024;
+
+        std::string_view trim(std::string_view s) {
+            while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+            while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+            return s;
+        }
+
+        bool iequals(std::string_view a, std::string_view b) {
+            return beast::iequals(
+                beast::string_view{ a.data(), a.size() },
+                beast::string_view{ b.data(), b.size() });
+        }
+
+        // the value of a parameter, which might be a quoted string
+        std::string unquote(std::string_view value) {
+            value = trim(value);
+            if (value.size() < 2 || value.front() != '"' || value.back() != '"')
+                return std::string{ value };
+            std::string result;
+            result.reserve(value.size() - 2);
+            for (std::size_t i = 1; i + 1 < value.size(); ++i) {
+                if (value[i] == '\\' && i + 2 < value.size()) ++i;
+                result += value[i];
+            }
+            return result;
+        }
+
+        // calls `f(key, value)` for each parameter of a header value,
+        // e.g. `form-data; name="a"; filename="b;c.txt"`
+        template <typename Func>
+        void for_each_parameter(std::string_view value, Func&& f) {
+            std::size_t pos = 0;
+            bool first = true;
+            while (pos <= value.size()) {
+                // the end of the parameter, skipping quoted strings
+                std::size_t end = pos;
+                bool quoted = false;
+                while (end < value.size() && (quoted || value[end] != ';')) {
+                    if (value[end] == '"') quoted = !quoted;
+                    else if (value[end] == '\\' && quoted) ++end;
+                    ++end;
+                }
+                end = std::min(end, value.size());
+                std::string_view param = trim(value.substr(pos, end - pos));
+                // the first one is the type
+                if (!first) {
+                    auto eq = param.find('=');
+                    if (eq != std::string_view::npos)
+                        f(trim(param.substr(0, eq)), param.substr(eq + 1));
+                }
+                first = false;
+                pos = end + 1;
+            }
+        }
+
+        // the position of the delimiter in `data`, or of a prefix of it
+        // at the end of `data` (`complete` is false), or `npos`
+        std::size_t find_delimiter(
+            std::string_view data, const std::string& delimiter, bool& complete) {
+            const char* begin = data.data();
+            const char* end = begin + data.size();
+            const char* p = begin;
+            while (p != end) {
+                p = static_cast<const char*>(std::memchr(p, '\r', end - p));
+                if (p == nullptr) break;
+                std::size_t n = std::min<std::size_t>(end - p, delimiter.size());
+                if (std::memcmp(p, delimiter.data(), n) == 0) {
+                    complete = n == delimiter.size();
+                    return p - begin;
+                }
+                ++p;
+            }
+            return std::string_view::npos;
+        }
+
+        // a repeated name is turned into an array
+        void add_field(
+            boost::json::object& fields,
+            const std::string& name,
+            boost::json::value&& value) {
+            auto it = fields.find(name);
+            if (it == fields.end()) {
+                fields[name] = std::move(value);
+                return;
+            }
+            if (!it->value().is_array()) {
+                boost::json::array values;
+                values.push_back(std::move(it->value()));
+                it->value() = std::move(values);
+            }
+            it->value().as_array().push_back(std::move(value));
+        }
+
+    }  // namespace
+
+    std::optional<std::string> multipart_boundary(beast::string_view content_type) {
+        std::string_view value{ content_type.data(), content_type.size() };
+        std::string_view type = trim(value.substr(0, value.find(';')));
+        if (!iequals(type, "multipart/form-data")) return std::nullopt;
+        std::optional<std::string> boundary;
+        for_each_parameter(value, [&boundary](std::string_view key, std::string_view val) {
+            if (iequals(key, "boundary")) boundary = unquote(val);
+            });
+        // RFC 2046: 1 to 70 characters
+        if (boundary.has_value() && (boundary->empty() || boundary->size() > 70))
+            return std::nullopt;
+        return boundary;
+    }
+
+    multipart_parser::multipart_parser(const std::string& boundary)
+        : delimiter_{ "\r\n--" + boundary },
+        state_{ state::preamble }, started_{ false } {}
+
+    void multipart_parser::write(std::string_view data) {
+        while (!data.empty() && state_ != state::epilogue) {
+            if (buffer_.empty()) {
+                std::size_t n = parse(data);
+                // keeps the bytes that cannot be parsed yet
+                buffer_.assign(data.data() + n, data.size() - n);
+                return;
+            }
+            // completes the bytes left with a few more bytes, so that
+            // the chunk is not copied as a whole
+            std::size_t n = std::min(data.size(),
+                state_ == state::headers ? HEADER_LIMIT : delimiter_.size());
+            buffer_.append(data.data(), n);
+            data.remove_prefix(n);
+            std::size_t consumed = parse(buffer_);
+            buffer_.erase(0, consumed);
+        }
+    }
+
+    void multipart_parser::finish() {
+        if (state_ != state::epilogue)
+            throw multipart_error{ "incomplete multipart body" };
+    }
+
+    std::size_t multipart_parser::parse(std::string_view data) {
+        std::size_t pos = 0;
+        while (pos < data.size()) {
+            std::string_view rest = data.substr(pos);
+            std::size_t n = 0;
+            switch (state_) {
+            case state::preamble:
+                n = parse_preamble(rest);
+                break;
+            case state::delimiter:
+                n = parse_delimiter(rest);
+                break;
+            case state::headers:
+                n = parse_headers(rest);
+                break;
+            case state::body:
+                n = parse_body(rest);
+                break;
+            case state::epilogue:
+                n = rest.size();
+                break;
+            }
+            // more data is needed
+            if (n == 0) break;
+            pos += n;
+        }
+        return pos;
+    }
+
+    std::size_t multipart_parser::parse_preamble(std::string_view data) {
+        // the body usually starts with the delimiter without the CRLF
+        std::string_view dash_boundary{ delimiter_.data() + 2, delimiter_.size() - 2 };
+        if (!started_) {
+            std::size_t n = std::min(data.size(), dash_boundary.size());
+            if (data.substr(0, n) == dash_boundary.substr(0, n)) {
+                if (n < dash_boundary.size()) return 0;
+                started_ = true;
+                state_ = state::delimiter;
+                return n;
+            }
+            started_ = true;
+        }
+        bool complete = false;
+        std::size_t pos = find_delimiter(data, delimiter_, complete);
+        if (pos == std::string_view::npos) return data.size();
+        if (!complete) return pos;
+        state_ = state::delimiter;
+        return pos + delimiter_.size();
+    }
+
+    std::size_t multipart_parser::parse_delimiter(std::string_view data) {
+        std::size_t i = 0;
+        while (i < data.size() && (data[i] == ' ' || data[i] == '\t')) ++i;
+        if (i > PADDING_LIMIT) throw multipart_error{ "malformed multipart delimiter" };
+        if (data.size() - i < 2) return 0;
+        std::string_view next = data.substr(i, 2);
+        if (next == "--") {
+            state_ = state::epilogue;
+            return i + 2;
+        }
+        if (next == "\r\n") {
+            state_ = state::headers;
+            return i + 2;
+        }
+        throw multipart_error{ "malformed multipart delimiter" };
+    }
+
+    std::size_t multipart_parser::parse_headers(std::string_view data) {
+        part_ = {};
+        std::size_t end;
+        if (data.substr(0, 2) == "\r\n") end = 0;
+        else {
+            end = data.find("\r\n\r\n");
+            if (end == std::string_view::npos) {
+                if (data.size() > HEADER_LIMIT)
+                    throw multipart_error{ "multipart headers are too large" };
+                return 0;
+            }
+            end += 2;
+        }
+        std::string_view headers = data.substr(0, end);
+        while (!headers.empty()) {
+            std::size_t eol = headers.find("\r\n");
+            std::string_view line = headers.substr(0, eol);
+            headers.remove_prefix(std::min(headers.size(), eol + 2));
+            std::size_t colon = line.find(':');
+            if (colon == std::string_view::npos)
+                throw multipart_error{ "malformed multipart header" };
+            std::string_view name = trim(line.substr(0, colon));
+            std::string_view value = trim(line.substr(colon + 1));
+            if (iequals(name, "content-disposition")) {
+                for_each_parameter(value, [this](std::string_view key, std::string_view val) {
+                    if (iequals(key, "name")) part_.name = unquote(val);
+                    else if (iequals(key, "filename")) part_.filename = unquote(val);
+                    });
+            }
+            else if (iequals(name, "content-type")) {
+                part_.content_type = std::string{ value };
+            }
+        }
+        if (on_part_begin) on_part_begin(part_);
+        state_ = state::body;
+        return end + 2;
+    }
+
+    std::size_t multipart_parser::parse_body(std::string_view data) {
+        bool complete = false;
+        std::size_t pos = find_delimiter(data, delimiter_, complete);
+        if (pos == std::string_view::npos) {
+            if (on_data) on_data(data);
+            return data.size();
+        }
+        if (pos > 0 && on_data) on_data(data.substr(0, pos));
+        // the rest might be the start of a delimiter
+        if (!complete) return pos;
+        if (on_part_end) on_part_end();
+        state_ = state::delimiter;
+        return pos + delimiter_.size();
+    }
+
+    boost::json::object read_multipart_form(
+        request_body_reader& body,
+        const multipart_file_handler& on_file) {
+        auto boundary = multipart_boundary(body.header()[http::field::content_type]);
+        if (!boundary.has_value())
+            throw multipart_error{ "the body is not multipart/form-data" };
+        boost::json::object fields;
+        multipart_parser parser{ boundary.value() };
+        const multipart_part* current = nullptr;
+        std::string value;
+        parser.on_part_begin = [&](const multipart_part& part) {
+            current = &part;
+            value.clear();
+        };
+        parser.on_data = [&](std::string_view data) {
+            if (current->filename.has_value()) {
+                on_file(*current, data);
+                return;
+            }
+            if (value.size() + data.size() > MULTIPART_FIELD_LIMIT)
+                throw multipart_error{ "the field `" + current->name + "` is too large" };
+            value.append(data);
+        };
+        parser.on_part_end = [&]() {
+            if (current->filename.has_value()) on_file(*current, {});
+            else add_field(fields, current->name, boost::json::string{ value });
+        };
+        auto buffer = std::make_unique<char[]>(READ_BUFFER_SIZE);
+        while (std::size_t n = body.read_some(buffer.get(), READ_BUFFER_SIZE))
+            parser.write({ buffer.get(), n });
+        parser.finish();
+        return fields;
+    }
+
+    boost::json::object read_multipart_form(request_body_reader& body) {
+        std::vector<std::pair<std::string, boost::json::object>> files;
+        std::ofstream file;
+        file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        std::string path;
+        std::uint64_t size = 0;
+        auto fields = read_multipart_form(body,
+            [&](const multipart_part& part, std::string_view data) {
+                if (!file.is_open()) {
+                    path = body.temp_file_path();
+                    file.open(path, std::ios::binary);
+                    size = 0;
+                }
+                if (!data.empty()) {
+                    file.write(data.data(), data.size());
+                    size += data.size();
+                    return;
+                }
+                file.close();
+                files.emplace_back(part.name, boost::json::object{
+                    {"filename", part.filename.value()},
+                    {"content_type", part.content_type},
+                    {"size", size},
+                    {"path", path} });
+            });
+        for (auto& [name, entry] : files)
+            add_field(fields, name, std::move(entry));
+        return fields;
+    }
+
+    boost::json::object parse_multipart_form(
+        std::string_view body, const std::string& boundary) {
+        boost::json::object fields;
+        multipart_parser parser{ boundary };
+        const multipart_part* current = nullptr;
+        std::string value;
+        parser.on_part_begin = [&](const multipart_part& part) {
+            current = &part;
+            value.clear();
+        };
+        parser.on_data = [&](std::string_view data) {
+            value.append(data);
+        };
+        parser.on_part_end = [&]() {
+            if (current->filename.has_value()) {
+                add_field(fields, current->name, boost::json::object{
+                    {"filename", current->filename.value()},
+                    {"content_type", current->content_type},
+                    {"content", value} });
+            }
+            else add_field(fields, current->name, boost::json::string{ value });
+        };
+        parser.write(body);
+        parser.finish();
+        return fields;
+    }
+
+}  // bserv
@@ -0,0 +1,299 @@
+#include "pch.h"
+#include "bserv/notification.hpp"
+#include "bserv/config.hpp"
+#include "bserv/logging.hpp"
+
+#include <algorithm>
+
+namespace bserv {
+
+    db_subscription::~db_subscription() {
+        if (auto listener = listener_.lock()) {
+            asio::dispatch(
+                listener->strand_,
+                [listener, channel = channel_, id = id_]() {
+                    listener->unsubscribe(channel, id);
+                });
+        }
+    }
+
+    void db_listener::receiver::operator()(
+        const std::string& payload, int /*backend_pid*/) {
+        // called by `get_notifs` on the worker thread
+        listener_.received_.emplace_back(channel(), payload);
+    }
+
+    db_listener::db_listener(asio::io_context& ioc, const std::string& conn_str)
+        : strand_{ asio::make_strand(ioc) },
+        socket_{ strand_ }, timer_{ strand_ },
+        conn_str_{ conn_str }, next_id_{ 0 },
+        backoff_{ DB_MIN_RECONNECT_BACKOFF },
+        connecting_{ false }, connected_{ false },
+        stopped_{ false },
+        worker_guard_{ asio::make_work_guard(worker_context_) },
+        worker_{ [this] { worker_context_.run(); } } {}
+
+    db_listener::~db_listener() {
+        // the handlers of the worker keep the listener alive,
+        // so none of them is pending here
+        worker_guard_.reset();
+        worker_context_.stop();
+        worker_.join();
+        // the socket belongs to the pqxx connection
+        if (socket_.is_open()) socket_.release();
+        // the receivers must be destroyed before the connection
+        receivers_.clear();
+    }
+
+    template <typename Work, typename Done>
+    void db_listener::run_blocking(const char* operation, Work work, Done done) {
+        asio::post(
+            worker_context_,
+            [self = shared_from_this(), operation,
+            work = std::move(work), done = std::move(done)]() mutable {
+                std::optional<decltype(work())> result;
+                try {
+                    result.emplace(work());
+                }
+                catch (const std::exception& e) {
+                    lgerror << "db_listener: " << operation << " failed: " << e.what();
+                }
+                // the listener is released on the strand, not on the
+                // worker thread, which cannot be joined from itself
+                auto& strand = self->strand_;
+                asio::post(
+                    strand,
+                    [self = std::move(self), done = std::move(done),
+                    result = std::move(result)]() mutable {
+                        done(std::move(result));
+                    });
+            });
+    }
+
+    std::vector<db_listener::notification_type> db_listener::take_received() {
+        // LISTEN and UNLISTEN may have read notifications
+        // that will not make the socket readable again
+        if (conn_ != nullptr) conn_->get_notifs();
+        std::vector<notification_type> received = std::move(received_);
+        received_.clear();
+        return received;
+    }
+
+    db_subscription db_listener::subscribe(
+        const std::string& channel,
+        std::shared_ptr<websocket_session> session) {
+        std::size_t id = next_id_++;
+        asio::dispatch(
+            strand_,
+            [self = shared_from_this(), channel, id,
+            weak_session = std::weak_ptr<websocket_session>{ session }]() {
+                if (self->stopped_) return;
+                auto& ch = self->channels_[channel];
+                ch.subscribers_[id] = weak_session;
+                if (!ch.listening_) self->listen(channel, ch);
+            });
+        return { weak_from_this(), channel, id };
+    }
+
+    void db_listener::stop() {
+        asio::dispatch(
+            strand_,
+            [self = shared_from_this()]() {
+                self->stopped_ = true;
+                self->timer_.cancel();
+                self->disconnect();
+                self->channels_.clear();
+            });
+    }
+
+    void db_listener::connect() {
+        connecting_ = true;
+        std::vector<std::string> channels;
+        for (auto& [channel, ch] : channels_) channels.push_back(channel);
+        run_blocking(
+            "connection",
+            [this, channels] {
+                try {
+                    conn_ = std::make_unique<pqxx::connection>(conn_str_);
+                    for (auto& channel : channels)
+                        receivers_[channel] = std::make_unique<receiver>(*this, *conn_, channel);
+                }
+                catch (...) {
+                    receivers_.clear();
+                    conn_.reset();
+                    throw;
+                }
+                return conn_->sock();
+            },
+            [this, channels](std::optional<int> sock) {
+                connecting_ = false;
+                if (!sock.has_value()) {
+                    reconnect_later();
+                    return;
+                }
+                connected_ = true;
+                if (stopped_) {
+                    disconnect();
+                    return;
+                }
+#ifdef _MSC_VER
+                socket_.assign(asio::ip::tcp::v4(), sock.value());
+#else
+                socket_.assign(sock.value());
+#endif
+                backoff_ = std::chrono::milliseconds{ DB_MIN_RECONNECT_BACKOFF };
+                // the channels unsubscribed while connecting are unlistened,
+                // and the ones subscribed meanwhile are listened
+                for (auto& channel : channels) {
+                    auto it = channels_.find(channel);
+                    if (it != channels_.end()) it->second.listening_ = true;
+                    else unlisten(channel);
+                }
+                for (auto& [channel, ch] : channels_)
+                    if (!ch.listening_) listen(channel, ch);
+                lginfo << "db_listener: connected, listening on "
+                    << channels_.size() << " channel(s)";
+                do_wait();
+            });
+    }
+
+    void db_listener::disconnect() {
+        if (!connected_) return;
+        connected_ = false;
+        if (socket_.is_open()) socket_.release();
+        for (auto& [channel, ch] : channels_) ch.listening_ = false;
+        run_blocking(
+            "disconnection",
+            [this] {
+                // the receivers must be destroyed before the connection
+                receivers_.clear();
+                conn_.reset();
+                return true;
+            },
+            [](std::optional<bool>) {});
+    }
+
+    void db_listener::on_failed() {
+        // the results of the other calls on the same connection are ignored
+        if (!connected_) return;
+        disconnect();
+        reconnect_later();
+    }
+
+    void db_listener::reconnect_later() {
+        if (stopped_) return;
+        timer_.expires_after(backoff_);
+        backoff_ = std::min(backoff_ * 2,
+            std::chrono::milliseconds{ DB_MAX_RECONNECT_BACKOFF });
+        timer_.async_wait(
+            [self = shared_from_this()](const boost::system::error_code& ec) {
+                if (ec || self->stopped_ || self->connected_ || self->connecting_) return;
+                // connects again on the next subscription
+                if (self->channels_.empty()) return;
+                self->connect();
+            });
+    }
+
+    void db_listener::do_wait() {
+        socket_.async_wait(
+            socket_type::wait_read,
+            beast::bind_front_handler(
+                &db_listener::on_wait,
+                shared_from_this()));
+    }
+
+    void db_listener::on_wait(const boost::system::error_code& ec) {
+        if (ec == asio::error::operation_aborted || stopped_ || !connected_) return;
+        if (ec) {
+            lgerror << "db_listener: connection lost: " << ec.message();
+            on_failed();
+            return;
+        }
+        run_blocking(
+            "reading notifications",
+            [this] { return take_received(); },
+            [this](std::optional<std::vector<notification_type>> received) {
+                on_received(std::move(received));
+                if (connected_) do_wait();
+            });
+    }
+
+    void db_listener::on_received(std::optional<std::vector<notification_type>> received) {
+        if (stopped_ || !connected_) return;
+        if (!received.has_value()) {
+            on_failed();
+            return;
+        }
+        for (auto& [channel, payload] : received.value()) notify(channel, payload);
+    }
+
+    void db_listener::listen(const std::string& channel, channel_type& ch) {
+        // `connect` listens on all the channels
+        if (!connected_) {
+            // a reconnection is scheduled
+            if (connecting_ || timer_.expiry() > std::chrono::steady_clock::now()) return;
+            connect();
+            return;
+        }
+        ch.listening_ = true;
+        run_blocking(
+            "listen",
+            [this, channel] {
+                if (conn_ != nullptr)
+                    receivers_[channel] = std::make_unique<receiver>(*this, *conn_, channel);
+                return take_received();
+            },
+            [this](std::optional<std::vector<notification_type>> received) {
+                on_received(std::move(received));
+            });
+    }
+
+    void db_listener::unlisten(const std::string& channel) {
+        // runs after the LISTEN of the channel, if it is subscribed again
+        // meanwhile, its LISTEN runs after this
+        run_blocking(
+            "unlisten",
+            [this, channel] {
+                // destroying the receiver runs UNLISTEN
+                receivers_.erase(channel);
+                return take_received();
+            },
+            [this](std::optional<std::vector<notification_type>> received) {
+                on_received(std::move(received));
+            });
+    }
+
+    void db_listener::notify(const std::string& channel, const std::string& payload) {
+        auto it = channels_.find(channel);
+        if (it == channels_.end()) return;
+        // the payload is shared by all the subscribers
+        auto message = std::make_shared<const std::string>(payload);
+        auto& subscribers = it->second.subscribers_;
+        for (auto sub = subscribers.begin(); sub != subscribers.end();) {
+            if (auto session = sub->second.lock()) {
+                // the notification is dropped for a slow consumer
+                if (session->writable()) session->send(message);
+                ++sub;
+            }
+            else sub = subscribers.erase(sub);
+        }
+        // the sessions closed without unsubscribing
+        if (subscribers.empty()) {
+            bool listening = it->second.listening_;
+            channels_.erase(it);
+            if (listening) unlisten(channel);
+        }
+    }
+
+    void db_listener::unsubscribe(const std::string& channel, std::size_t id) {
+        auto it = channels_.find(channel);
+        if (it == channels_.end()) return;
+        it->second.subscribers_.erase(id);
+        if (!it->second.subscribers_.empty()) return;
+        // UNLISTEN runs on the worker thread
+        bool listening = it->second.listening_;
+        channels_.erase(it);
+        if (listening) unlisten(channel);
+    }
+
+}  // bserv
@@ -0,0 +1,338 @@
+#include "pch.h"
+#include "bserv/params.hpp"
+#include "bserv/multipart.hpp"
+#include "bserv/utils.hpp"
+
+#include <boost/json/basic_parser_impl.hpp>
+
+#include <memory>
+
+namespace bserv {
+
+    namespace {
+
+        // the size of the buffer used to read the body of a streaming route
+        const std::size_t READ_BUFFER_SIZE = 64 * 1024;
+
+        // e.g. `application/json` of `application/json; charset=UTF-8`
+        std::string media_type(beast::string_view content_type) {
+            std::string type;
+            for (auto& c : content_type) {
+                if (c == ' ') continue;
+                else if (c == ';') break;
+                type += c;
+            }
+            return type;
+        }
+
+        void add_params(
+            boost::json::object& fields,
+            const std::map<std::string, std::string>& dict_params,
+            const std::map<std::string, std::vector<std::string>>& list_params) {
+            for (auto& [k, v] : dict_params) {
+                if (!fields.contains(k)) {
+                    fields[k] = v;
+                }
+            }
+            for (auto& [k, vs] : list_params) {
+                if (!fields.contains(k)) {
+                    boost::json::array a;
+                    for (auto& v : vs) {
+                        a.push_back(boost::json::string{ v });
+                    }
+                    fields[k] = a;
+                }
+            }
+        }
+
+        // looks up a key of the top-level object of a json text:
+        // only the value of the key is built (with a `value_stack`, like
+        // `boost::json::parser` does for the whole text). the parse goes
+        // to the end, so that the last of the duplicate keys is found,
+        // the same as `boost::json::parse`.
+        class key_lookup_handler {
+        private:
+            std::string_view key_;
+            // the top-level key being parsed
+            std::string current_key_;
+            int depth_;
+            bool capturing_;
+            boost::json::value_stack st_;
+            bool complete(boost::json::error_code&) {
+                if (depth_ != 1) return true;
+                value = st_.release();
+                capturing_ = false;
+                return true;
+            }
+            // the top-level value is not an object
+            bool root(boost::json::error_code& ec) {
+                if (depth_ != 0) return true;
+                not_object = true;
+                ec = boost::system::errc::make_error_code(
+                    boost::system::errc::operation_canceled);
+                return false;
+            }
+        public:
+            constexpr static std::size_t max_object_size = std::size_t(-1);
+            constexpr static std::size_t max_array_size = std::size_t(-1);
+            constexpr static std::size_t max_key_size = std::size_t(-1);
+            constexpr static std::size_t max_string_size = std::size_t(-1);
+
+            std::optional<boost::json::value> value;
+            bool not_object = false;
+
+            explicit key_lookup_handler(std::string_view key)
+                : key_{ key }, depth_{ 0 }, capturing_{ false } {}
+
+            bool on_document_begin(boost::json::error_code&) { return true; }
+            bool on_document_end(boost::json::error_code&) { return true; }
+            bool on_object_begin(boost::json::error_code&) {
+                ++depth_;
+                return true;
+            }
+            bool on_object_end(std::size_t n, boost::json::error_code& ec) {
+                --depth_;
+                if (!capturing_) return true;
+                st_.push_object(n);
+                return complete(ec);
+            }
+            bool on_array_begin(boost::json::error_code& ec) {
+                if (!root(ec)) return false;
+                ++depth_;
+                return true;
+            }
+            bool on_array_end(std::size_t n, boost::json::error_code& ec) {
+                --depth_;
+                if (!capturing_) return true;
+                st_.push_array(n);
+                return complete(ec);
+            }
+            bool on_key_part(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+                if (capturing_) st_.push_chars(s);
+                else if (depth_ == 1) current_key_.append(s.data(), s.size());
+                return true;
+            }
+            bool on_key(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+                if (capturing_) {
+                    st_.push_key(s);
+                    return true;
+                }
+                if (depth_ != 1) return true;
+                current_key_.append(s.data(), s.size());
+                if (current_key_ == key_) {
+                    capturing_ = true;
+                    st_.reset();
+                }
+                current_key_.clear();
+                return true;
+            }
+            bool on_string_part(boost::json::string_view s, std::size_t, boost::json::error_code&) {
+                if (capturing_) st_.push_chars(s);
+                return true;
+            }
+            bool on_string(boost::json::string_view s, std::size_t, boost::json::error_code& ec) {
+                if (!root(ec)) return false;
+                if (!capturing_) return true;
+                st_.push_string(s);
+                return complete(ec);
+            }
+            bool on_number_part(boost::json::string_view, boost::json::error_code&) { return true; }
+            bool on_int64(std::int64_t i, boost::json::string_view, boost::json::error_code& ec) {
+                if (!root(ec)) return false;
+                if (!capturing_) return true;
+                st_.push_int64(i);
+                return complete(ec);
+            }
+            bool on_uint64(std::uint64_t u, boost::json::string_view, boost::json::error_code& ec) {
+                if (!root(ec)) return false;
+                if (!capturing_) return true;
+                st_.push_uint64(u);
+                return complete(ec);
+            }
+            bool on_double(double d, boost::json::string_view, boost::json::error_code& ec) {
+                if (!root(ec)) return false;
+                if (!capturing_) return true;
+                st_.push_double(d);
+                return complete(ec);
+            }
+            bool on_bool(bool b, boost::json::error_code& ec) {
+                if (!root(ec)) return false;
+                if (!capturing_) return true;
+                st_.push_bool(b);
+                return complete(ec);
+            }
+            bool on_null(boost::json::error_code& ec) {
+                if (!root(ec)) return false;
+                if (!capturing_) return true;
+                st_.push_null();
+                return complete(ec);
+            }
+            bool on_comment_part(boost::json::string_view, boost::json::error_code&) { return true; }
+            bool on_comment(boost::json::string_view, boost::json::error_code&) { return true; }
+        };
+
+    }  // namespace
+
+    request_params::request_params(
+        const request_type& request,
+        request_body_reader* body_reader)
+        : request_{ request },
+        body_reader_{ body_reader },
+        kind_{ body_kind::none } {
+        bool has_body = !request_.body().empty()
+            || (body_reader_ != nullptr && !body_reader_->done());
+        if (!has_body) return;
+        std::string type = media_type(request_[http::field::content_type]);
+        if (type == "application/json") kind_ = body_kind::json;
+        else if (type == "application/x-www-form-urlencoded"
+            || type == "multipart/form-data") kind_ = body_kind::form;
+    }
+
+    const boost::json::object& request_params::form() {
+        if (form_.has_value()) return form_.value();
+        form_.emplace();
+        auto content_type = request_[http::field::content_type];
+        if (media_type(content_type) == "multipart/form-data") {
+            auto boundary = multipart_boundary(content_type);
+            if (!boundary.has_value()) throw bad_request_exception{};
+            try {
+                // the file parts of a streaming route are spooled to disk
+                form_ = body_reader_ != nullptr
+                    ? read_multipart_form(*body_reader_)
+                    : parse_multipart_form(request_.body(), boundary.value());
+            }
+            catch (const multipart_error& /*e*/) {
+                throw bad_request_exception{};
+            }
+        }
+        else {
+            std::string copied_body = body_reader_ != nullptr
+                ? body_reader_->read_all()
+                : std::string{ request_.body() };
+            auto&& [dict_params, list_params] = utils::parse_params(copied_body);
+            add_params(form_.value(), dict_params, list_params);
+        }
+        return form_.value();
+    }
+
+    const boost::json::object& request_params::query() {
+        if (query_.has_value()) return query_.value();
+        query_.emplace();
+        auto target = request_.target();
+        // most of the requests do not have a query string
+        if (target.find('?') == beast::string_view::npos) return query_.value();
+        std::string copied_target{ target };
+        auto&& [url, dict_params, list_params] = utils::parse_url(copied_target);
+        boost::ignore_unused(url);
+        add_params(query_.value(), dict_params, list_params);
+        return query_.value();
+    }
+
+    const boost::json::value* request_params::find_in_body(std::string_view key) {
+        if (found_.has_value()) {
+            if (found_->first == key)
+                return found_->second.has_value() ? &found_->second.value() : nullptr;
+            // each pass goes through the whole body, so the object
+            // is built for the second key instead of another pass
+            auto& fields = object();
+            auto it = fields.find(key);
+            return it != fields.end() ? &it->value() : nullptr;
+        }
+        const auto& body = request_.body();
+        boost::json::basic_parser<key_lookup_handler> parser{
+            boost::json::parse_options{}, key };
+        boost::json::error_code ec;
+        auto n = parser.write_some(false, body.data(), body.size(), ec);
+        auto& handler = parser.handler();
+        if (handler.not_object || ec || n != body.size())
+            throw bad_request_exception{};
+        found_.emplace(std::string{ key }, std::move(handler.value));
+        return found_->second.has_value() ? &found_->second.value() : nullptr;
+    }
+
+    const boost::json::value* request_params::find(std::string_view key) {
+        if (object_.has_value()) {
+            auto it = object_->find(key);
+            return it != object_->end() ? &it->value() : nullptr;
+        }
+        if (kind_ == body_kind::json) {
+            // the body of a streaming route is not held in memory
+            if (body_reader_ != nullptr) {
+                object();
+                return find(key);
+            }
+            if (auto value = find_in_body(key)) return value;
+        }
+        else if (kind_ == body_kind::form) {
+            auto& fields = form();
+            auto it = fields.find(key);
+            if (it != fields.end()) return &it->value();
+        }
+        return find_in_query(key);
+    }
+
+    const boost::json::value* request_params::find_in_query(std::string_view key) {
+        auto& fields = query();
+        auto it = fields.find(key);
+        return it != fields.end() ? &it->value() : nullptr;
+    }
+
+    std::string_view request_params::get_string(
+        std::string_view key, std::string_view default_value) {
+        auto value = find(key);
+        if (value == nullptr || !value->is_string()) return default_value;
+        auto& s = value->get_string();
+        return { s.data(), s.size() };
+    }
+
+    boost::json::object request_params::parse_body() {
+        if (kind_ == body_kind::form) {
+            form();
+            return std::move(form_.value());
+        }
+        if (kind_ != body_kind::json) return {};
+        try {
+            boost::json::value body;
+            if (body_reader_ != nullptr) {
+                // parses the body as it is read
+                boost::json::stream_parser parser;
+                auto buffer = std::make_unique<char[]>(READ_BUFFER_SIZE);
+                while (std::size_t n = body_reader_->read_some(buffer.get(), READ_BUFFER_SIZE))
+                    parser.write(boost::json::string_view{ buffer.get(), n });
+                parser.finish();
+                body = parser.release();
+            }
+            else body = boost::json::parse(request_.body());
+            return std::move(body.as_object());
+        }
+        catch (const payload_too_large_exception&) {
+            throw;
+        }
+        catch (const request_stream_closed&) {
+            throw;
+        }
+        catch (const std::exception& /*e*/) {
+            throw bad_request_exception{};
+        }
+    }
+
+    boost::json::object& request_params::object() {
+        if (object_.has_value()) return object_.value();
+        boost::json::object body = parse_body();
+        for (auto& field : query()) {
+            if (!body.contains(field.key())) {
+                body[field.key()] = field.value();
+            }
+        }
+        object_ = std::move(body);
+        return object_.value();
+    }
+
+    boost::json::object request_params::release() {
+        object();
+        boost::json::object body = std::move(object_.value());
+        object_.reset();
+        return body;
+    }
+
+}  // bserv
@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "bserv/rate_limit.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+namespace bserv {
+
+    namespace {
+
+        std::int64_t now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+    }  // namespace
+
+    rate_limiter::rate_limiter(double rate, double burst)
+        : interval_{ static_cast<std::int64_t>(1e9 / rate) },
+        capacity_{ static_cast<std::int64_t>(1e9 / rate * (std::max)(burst, 1.0)) },
+        rejected_{ 0 } {}
+
+    bool rate_limiter::take(bucket& b, std::int64_t now) {
+        std::int64_t full_at = b.full_at.load(std::memory_order_relaxed);
+        for (;;) {
+            // a bucket that is full is refilled up to its capacity only
+            std::int64_t next = (std::max)(full_at, now) + interval_;
+            if (next - now > capacity_) {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (b.full_at.compare_exchange_weak(
+                full_at, next, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    void rate_limiter::evict(shard& s, std::int64_t now) {
+        // a full bucket is the same as a new one, so they are dropped first
+        for (auto it = s.buckets.begin(); it != s.buckets.end();) {
+            if (it->second->full_at.load(std::memory_order_relaxed) <= now)
+                it = s.buckets.erase(it);
+            else ++it;
+        }
+        // then the buckets closest to full, down to half of the shard,
+        // so that the scan is amortized over the keys inserted until the next one
+        const std::size_t keep = RATE_LIMIT_SHARD_BUCKETS / 2;
+        if (s.buckets.size() <= keep) return;
+        using iterator = decltype(s.buckets)::iterator;
+        std::vector<std::pair<std::int64_t, iterator>> buckets;
+        buckets.reserve(s.buckets.size());
+        for (auto it = s.buckets.begin(); it != s.buckets.end(); ++it)
+            buckets.emplace_back(it->second->full_at.load(std::memory_order_relaxed), it);
+        std::size_t n = buckets.size() - keep;
+        std::nth_element(
+            buckets.begin(), buckets.begin() + n, buckets.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (std::size_t i = 0; i < n; ++i) s.buckets.erase(buckets[i].second);
+    }
+
+    bool rate_limiter::try_acquire(const std::string& key) {
+        shard& s = shards_[std::hash<std::string>{}(key) % RATE_LIMIT_SHARDS];
+        std::int64_t now = now_ns();
+        {
+            std::shared_lock<std::shared_mutex> lg{ s.lock };
+            auto it = s.buckets.find(key);
+            if (it != s.buckets.end())
+                return take(*it->second, now);
+        }
+        std::unique_lock<std::shared_mutex> lg{ s.lock };
+        if (s.buckets.size() >= RATE_LIMIT_SHARD_BUCKETS) evict(s, now);
+        auto& b = s.buckets[key];
+        if (b == nullptr) {
+            b = std::make_unique<bucket>();
+            b->full_at.store(now, std::memory_order_relaxed);
+        }
+        return take(*b, now);
+    }
+
+}  // bserv
@@ -0,0 +1,245 @@
+#include "pch.h"
+#include "bserv/stream.hpp"
+#include "bserv/config.hpp"
+#include "bserv/utils.hpp"
+#include "bserv/logging.hpp"
+
+#include <fstream>
+#include <memory>
+#include <filesystem>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+namespace bserv {
+
+    namespace {
+
+        // the size of the buffer used by `save_to`
+        const std::size_t SPOOL_BUFFER_SIZE = 64 * 1024;
+
+    }  // namespace
+
+    request_body_reader::~request_body_reader() {
+        for (auto& path : spooled_) {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            if (ec) lgwarning << "failed to remove " << path << ": " << ec.message();
+        }
+    }
+
+    void request_body_reader::send_continue() {
+        if (continued_) return;
+        continued_ = true;
+        auto& header = parser_.get();
+        if (!beast::iequals(header[http::field::expect], "100-continue")) return;
+        http::response<http::empty_body> res{ http::status::continue_, header.version() };
+        beast::error_code ec;
+        stream_.expires_after(std::chrono::seconds(EXPIRY_TIME));
+        http::async_write(stream_, res, yield_[ec]);
+        if (ec) {
+            failed_ = true;
+            throw request_stream_closed{};
+        }
+    }
+
+    std::size_t request_body_reader::read_some(char* data, std::size_t size) {
+        if (failed_) throw request_stream_closed{};
+        if (parser_.is_done() || size == 0) return 0;
+        send_continue();
+        auto& body = parser_.get().body();
+        body.data = data;
+        body.size = size;
+        beast::error_code ec;
+        stream_.expires_after(std::chrono::seconds(EXPIRY_TIME));
+        // reads until `data` is full or the body ends
+        http::async_read(stream_, buffer_, parser_, yield_[ec]);
+        if (ec == http::error::need_buffer) ec = {};
+        if (ec) {
+            failed_ = true;
+            if (ec == http::error::body_limit) throw payload_too_large_exception{};
+            throw request_stream_closed{};
+        }
+        return size - body.size;
+    }
+
+    std::string request_body_reader::read_all() {
+        std::string body;
+        std::size_t size = 0;
+        // the declared length is only trusted as far as the data arrives,
+        // the buffer grows from `SPOOL_BUFFER_SIZE` up to it
+        std::size_t limit = std::numeric_limits<std::size_t>::max();
+        if (auto length = content_length(); length.has_value()
+            && length.value() < limit)
+            limit = static_cast<std::size_t>(length.value());
+        body.resize(std::min(limit, SPOOL_BUFFER_SIZE));
+        while (!parser_.is_done()) {
+            if (size == body.size())
+                body.resize(std::max(
+                    std::min(limit, body.size() * 2), size + SPOOL_BUFFER_SIZE));
+            size += read_some(body.data() + size, body.size() - size);
+        }
+        body.resize(size);
+        return body;
+    }
+
+    std::uint64_t request_body_reader::save_to(const std::string& path) {
+        std::ofstream file;
+        file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        file.open(path, std::ios::binary);
+        auto buffer = std::make_unique<char[]>(SPOOL_BUFFER_SIZE);
+        std::uint64_t total = 0;
+        while (std::size_t n = read_some(buffer.get(), SPOOL_BUFFER_SIZE)) {
+            file.write(buffer.get(), n);
+            total += n;
+        }
+        return total;
+    }
+
+    std::string request_body_reader::spool() {
+        std::string path = temp_file_path();
+        save_to(path);
+        return path;
+    }
+
+    std::string request_body_reader::temp_file_path() {
+        std::string path = (std::filesystem::temp_directory_path()
+            / (NAME + "-upload-" + utils::generate_random_string(16))).string();
+        spooled_.push_back(path);
+        return path;
+    }
+
+    std::optional<std::uint64_t> request_body_reader::content_length() const {
+        auto length = parser_.content_length();
+        if (length.has_value()) return length.value();
+        return std::nullopt;
+    }
+
+    template <typename Buffers>
+    void response_writer::do_write(const Buffers& buffers) {
+        if (failed_) throw response_stream_closed{};
+        beast::error_code ec;
+        // each write has its own timeout, so that a long stream
+        // is not cut by the timeout of the request
+        stream_.expires_after(std::chrono::seconds(EXPIRY_TIME));
+        asio::async_write(stream_, buffers, yield_[ec]);
+        if (ec) {
+            failed_ = true;
+            throw response_stream_closed{};
+        }
+    }
+
+    void response_writer::set_started() {
+        started_ = true;
+        if (on_start_) {
+            auto callback = std::move(on_start_);
+            on_start_ = nullptr;
+            callback();
+        }
+    }
+
+    void response_writer::start() {
+        if (started_) return;
+        set_started();
+        http::response<http::empty_body, fields_type> header{ response_.base() };
+        header.keep_alive(response_.keep_alive() && request_.keep_alive());
+        header.chunked(true);
+        http::response_serializer<http::empty_body, fields_type> sr{ header };
+        beast::error_code ec;
+        stream_.expires_after(std::chrono::seconds(EXPIRY_TIME));
+        http::async_write_header(stream_, sr, yield_[ec]);
+        if (ec) {
+            failed_ = true;
+            throw response_stream_closed{};
+        }
+        response_.keep_alive(header.keep_alive());
+    }
+
+    void response_writer::write(std::string_view chunk) {
+        if (finished_) return;
+        start();
+        // an empty chunk would end the body,
+        // and the response to HEAD has no body
+        if (chunk.empty() || request_.method() == http::verb::head) return;
+        do_write(http::make_chunk(asio::const_buffer{ chunk.data(), chunk.size() }));
+    }
+
+    void response_writer::write_body(std::string_view body) {
+        if (started_) throw std::logic_error{ "response_writer: the header has been sent" };
+        set_started();
+        finished_ = true;
+        http::response<http::empty_body, fields_type> header{ response_.base() };
+        header.keep_alive(response_.keep_alive() && request_.keep_alive());
+        header.content_length(body.size());
+        response_.keep_alive(header.keep_alive());
+        http::response_serializer<http::empty_body, fields_type> sr{ header };
+        beast::error_code ec;
+        stream_.expires_after(std::chrono::seconds(EXPIRY_TIME));
+        http::async_write_header(stream_, sr, yield_[ec]);
+        if (ec) {
+            failed_ = true;
+            throw response_stream_closed{};
+        }
+        if (request_.method() != http::verb::head)
+            do_write(asio::const_buffer{ body.data(), body.size() });
+    }
+
+    void response_writer::finish() {
+        if (finished_ || failed_) return;
+        start();
+        finished_ = true;
+        if (request_.method() == http::verb::head) return;
+        do_write(http::make_chunk_last());
+    }
+
+    sse_writer::sse_writer(response_writer& writer)
+        : writer_{ writer } {
+        auto& response = writer_.response();
+        response.set(http::field::content_type, "text/event-stream");
+        response.set(http::field::cache_control, "no-cache");
+        writer_.start();
+    }
+
+    void sse_writer::send(
+        std::string_view data,
+        std::string_view event,
+        std::string_view id) {
+        std::string message;
+        message.reserve(data.size() + event.size() + id.size() + 32);
+        if (!event.empty()) {
+            message += "event: ";
+            message += event;
+            message += '\n';
+        }
+        if (!id.empty()) {
+            message += "id: ";
+            message += id;
+            message += '\n';
+        }
+        std::size_t pos = 0;
+        do {
+            std::size_t end = data.find('\n', pos);
+            if (end == std::string_view::npos) end = data.size();
+            message += "data: ";
+            message += data.substr(pos, end - pos);
+            message += '\n';
+            pos = end + 1;
+        } while (pos <= data.size());
+        message += '\n';
+        writer_.write(message);
+    }
+
+    void sse_writer::comment(std::string_view text) {
+        std::string message;
+        message.reserve(text.size() + 3);
+        message += ':';
+        message += text;
+        message += "\n\n";
+        writer_.write(message);
+    }
+
+    void sse_writer::retry(std::chrono::milliseconds delay) {
+        writer_.write("retry: " + std::to_string(delay.count()) + "\n\n");
+    }
+
+}  // bserv
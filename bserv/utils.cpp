@@ -3,9 +3,18 @@
 #include "bserv/router.hpp"
 
 #include <mutex>
+#include <list>
+#include <unordered_map>
+#include <iterator>
 #include <sstream>
 #include <iomanip>
 #include <fstream>
+#include <filesystem>
+#include <memory>
+#include <cstdint>
+
+#include <boost/beast/zlib.hpp>
+#include <boost/crc.hpp>
 
 #include <cryptopp/cryptlib.h>
 #include <cryptopp/pwdbased.h>
@@ -235,6 +244,140 @@ namespace bserv::utils {
 		return std::make_tuple(url, dict_params, list_params);
 	}
 
+	namespace compression {
+
+		encoding negotiate(boost::beast::string_view accept_encoding) {
+			using boost::beast::iequals;
+			// an explicit coding overrides "*", even with q=0
+			std::optional<bool> gzip, deflate;
+			bool any = false;
+			std::size_t start = 0;
+			while (start < accept_encoding.size()) {
+				std::size_t end = accept_encoding.find(',', start);
+				if (end == boost::beast::string_view::npos) end = accept_encoding.size();
+				boost::beast::string_view item = accept_encoding.substr(start, end - start);
+				start = end + 1;
+				// e.g. "gzip;q=0.8"
+				std::size_t semicolon = item.find(';');
+				boost::beast::string_view coding = item.substr(0, semicolon);
+				while (!coding.empty() && coding.front() == ' ') coding.remove_prefix(1);
+				while (!coding.empty() && coding.back() == ' ') coding.remove_suffix(1);
+				bool acceptable = true;
+				if (semicolon != boost::beast::string_view::npos) {
+					std::size_t q = item.find("q=", semicolon);
+					if (q != boost::beast::string_view::npos) {
+						// "q=0", "q=0.0" and so on
+						boost::beast::string_view value = item.substr(q + 2);
+						value = value.substr(0, value.find(';'));
+						acceptable = value.find_first_not_of("0. ") != boost::beast::string_view::npos;
+					}
+				}
+				if (iequals(coding, "gzip") || iequals(coding, "x-gzip"))
+					gzip = gzip.value_or(false) || acceptable;
+				else if (iequals(coding, "deflate"))
+					deflate = deflate.value_or(false) || acceptable;
+				else if (coding == "*") any = acceptable;
+			}
+			if (gzip.value_or(any)) return encoding::gzip;
+			if (deflate.value_or(any)) return encoding::deflate;
+			return encoding::identity;
+		}
+
+		bool compressible(boost::beast::string_view content_type) {
+			using boost::beast::iequals;
+			boost::beast::string_view mime = content_type.substr(0, content_type.find(';'));
+			if (mime.substr(0, 5) == "text/") return true;
+			for (auto type : {
+				"application/json", "application/javascript",
+				"application/xml", "image/svg+xml" })
+				if (iequals(mime, type)) return true;
+			return false;
+		}
+
+		namespace {
+
+			// appends the raw deflate stream (RFC 1951) of `data` to `out`
+			void raw_deflate(std::string_view data, int level, std::string& out) {
+				namespace zlib = boost::beast::zlib;
+				zlib::deflate_stream ds;
+				ds.reset(level, 15, 8, zlib::Strategy::normal);
+				zlib::z_params zs;
+				zs.next_in = data.data();
+				zs.avail_in = data.size();
+				std::size_t offset = out.size();
+				out.resize(offset + data.size() / 2 + 64);
+				while (true) {
+					zs.next_out = &out[offset + zs.total_out];
+					zs.avail_out = out.size() - offset - zs.total_out;
+					boost::beast::error_code ec;
+					ds.write(zs, zlib::Flush::finish, ec);
+					if (ec == zlib::error::end_of_stream) break;
+					// the output buffer is full
+					if (zs.avail_out == 0 || ec == zlib::error::need_buffers)
+						out.resize(out.size() + out.size() / 2 + 64);
+					else if (ec) throw boost::system::system_error{ ec };
+				}
+				out.resize(offset + zs.total_out);
+			}
+
+			// little-endian
+			void put32(std::string& out, std::uint32_t x) {
+				for (int i = 0; i < 4; ++i) out += (char)(x >> (i * 8));
+			}
+
+		}  // namespace
+
+		std::string gzip(std::string_view data, int level) {
+			// the header of RFC 1952: no name, no mtime, unknown OS
+			std::string out{ "\x1f\x8b\x08\0\0\0\0\0\0\xff", 10 };
+			raw_deflate(data, level, out);
+			boost::crc_32_type crc;
+			crc.process_bytes(data.data(), data.size());
+			put32(out, crc.checksum());
+			put32(out, (std::uint32_t)data.size());
+			return out;
+		}
+
+		std::string deflate(std::string_view data, int level) {
+			// 32K window, default compression, no dictionary
+			std::string out{ "\x78\x9c", 2 };
+			raw_deflate(data, level, out);
+			std::uint32_t a = 1, b = 0;
+			for (unsigned char c : data) {
+				a = (a + c) % 65521;
+				b = (b + a) % 65521;
+			}
+			std::uint32_t adler = (b << 16) | a;
+			// big-endian
+			for (int i = 3; i >= 0; --i) out += (char)(adler >> (i * 8));
+			return out;
+		}
+
+		void compress_response(
+			const request_type& request,
+			response_type& response,
+			int level, std::size_t threshold) {
+			if (level <= 0
+				|| response.body().size() < threshold
+				|| response.count(http::field::content_encoding) != 0
+				|| !compressible(response[http::field::content_type]))
+				return;
+			// the response varies even if this client gets it uncompressed
+			response.set(http::field::vary, "Accept-Encoding");
+			encoding enc = negotiate(request[http::field::accept_encoding]);
+			if (enc == encoding::identity) return;
+			std::string body = enc == encoding::gzip
+				? gzip(response.body(), level)
+				: deflate(response.body(), level);
+			if (body.size() >= response.body().size()) return;
+			response.body() = std::move(body);
+			response.set(http::field::content_encoding,
+				enc == encoding::gzip ? "gzip" : "deflate");
+			response.prepare_payload();
+		}
+
+	}  // compression
+
 	namespace file {
 
 		std::string read_bin(const std::string& filename) {
@@ -297,6 +440,122 @@ namespace bserv::utils {
 			return std::nullopt;
 		}
 
+		namespace {
+
+			struct compressed_file {
+				std::string filename;
+				std::filesystem::file_time_type last_write_time;
+				std::shared_ptr<const std::string> data;
+			};
+
+			// the least recently used file is at the back,
+			// and it is evicted when the budget is exceeded
+			class compressed_file_cache {
+			private:
+				std::mutex lock_;
+				std::list<compressed_file> files_;
+				std::unordered_map<std::string, std::list<compressed_file>::iterator> index_;
+				std::size_t size_ = 0;
+				void erase(std::list<compressed_file>::iterator it) {
+					size_ -= it->data->size();
+					index_.erase(it->filename);
+					files_.erase(it);
+				}
+			public:
+				std::shared_ptr<const std::string> find(
+					const std::string& filename,
+					std::filesystem::file_time_type last_write_time) {
+					std::lock_guard<std::mutex> lg{ lock_ };
+					auto it = index_.find(filename);
+					if (it == index_.end()) return nullptr;
+					if (it->second->last_write_time != last_write_time) {
+						erase(it->second);
+						return nullptr;
+					}
+					files_.splice(files_.begin(), files_, it->second);
+					return it->second->data;
+				}
+				void put(
+					const std::string& filename,
+					std::filesystem::file_time_type last_write_time,
+					std::shared_ptr<const std::string> data) {
+					// a file larger than the budget is not cached
+					if (data->size() > STATIC_GZIP_CACHE_SIZE) return;
+					std::lock_guard<std::mutex> lg{ lock_ };
+					auto it = index_.find(filename);
+					if (it != index_.end()) erase(it->second);
+					while (size_ + data->size() > STATIC_GZIP_CACHE_SIZE)
+						erase(std::prev(files_.end()));
+					size_ += data->size();
+					files_.push_front({ filename, last_write_time, std::move(data) });
+					index_[filename] = files_.begin();
+				}
+			} compressed_files;
+
+			// the file is compressed once and reused until it is modified
+			std::shared_ptr<const std::string> get_compressed(const std::string& filename) {
+				std::error_code ec;
+				auto last_write_time = std::filesystem::last_write_time(filename, ec);
+				if (ec) throw file_not_found{ filename };
+				if (auto data = compressed_files.find(filename, last_write_time))
+					return data;
+				auto data = std::make_shared<const std::string>(
+					compression::gzip(read_bin(filename)));
+				compressed_files.put(filename, last_write_time, data);
+				return data;
+			}
+
+			// the gzip variant of `filename` if the client accepts it,
+			// `nullptr` if the file should be served as it is
+			std::shared_ptr<const std::string> negotiate_gzip(
+				const request_type& request,
+				response_type& response,
+				const std::string& filename) {
+				auto content_type = mime_type(filename);
+				if (!compression::compressible(content_type)) return nullptr;
+				response.set(http::field::vary, "Accept-Encoding");
+				if (compression::negotiate(request[http::field::accept_encoding])
+					!= compression::encoding::gzip)
+					return nullptr;
+				std::shared_ptr<const std::string> data;
+				try {
+					std::error_code ec;
+					if (std::filesystem::is_regular_file(filename + ".gz", ec))
+						data = std::make_shared<const std::string>(read_bin(filename + ".gz"));
+					else data = get_compressed(filename);
+				}
+				catch (const file_not_found&) {
+					throw url_not_found_exception{};
+				}
+				response.set(http::field::content_type, content_type);
+				response.set(http::field::content_encoding, "gzip");
+				return data;
+			}
+
+		}  // namespace
+
+		std::nullopt_t serve(
+			const request_type& request,
+			response_type& response,
+			const std::string& filename) {
+			auto data = negotiate_gzip(request, response, filename);
+			if (data == nullptr) return serve(response, filename);
+			response.body() = *data;
+			response.prepare_payload();
+			return std::nullopt;
+		}
+
+		std::nullopt_t serve(
+			const request_type& request,
+			response_writer& writer,
+			const std::string& filename) {
+			auto data = negotiate_gzip(request, writer.response(), filename);
+			if (data == nullptr) return serve(writer.response(), filename);
+			// written from the cache, which is kept alive by `data`
+			writer.write_body(*data);
+			return std::nullopt;
+		}
+
 	}  // file
 
 }  // bserv::utils
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <array>
+#include <functional>
+#include <cstdlib>
+#include <csignal>
+#include <new>
+#include <thread>
+#include <optional>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <bserv/common.hpp>
+#include <bserv/headers.hpp>
+#include <bserv/memory.hpp>
+// checks that a keep-alive connection does not allocate once it is
+// warmed up: the requests to `/hello` sent to a server through
+// `http_session`, and the pieces of it outside of a session:
+// writing a prebuilt response with the handler memory of the session,
+// and parsing the requests with the pooled fields and the recycled body.
+// the handler sets the body of the response of the session, since
+// serializing a json value allocates.
+std::atomic<std::size_t> allocations{ 0 };
+void* operator new(std::size_t size) {
+	++allocations;
+	if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+	throw std::bad_alloc{};
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using asio::ip::tcp;
+const int WARM_UP = 10;
+const int N = 1000;  // number of responses
+const unsigned short PORT = 8089;
+std::nullopt_t hello(bserv::response_type& response) {
+	response.body().assign(R"({"msg":"hello, world!"})");
+	response.prepare_payload();
+	return std::nullopt;
+}
+// sends the requests to `/hello` on a keep-alive connection to the
+// server, and returns the number of allocations made (by both the
+// server and the client) for the last `N` of them.
+std::size_t count_session(bool& ok) {
+	asio::io_context ioc;
+	tcp::socket socket{ ioc };
+	const tcp::endpoint endpoint{ asio::ip::make_address("127.0.0.1"), PORT };
+	// waits for the server to start listening
+	for (int i = 0;; ++i) {
+		beast::error_code ec;
+		socket.connect(endpoint, ec);
+		if (!ec) break;
+		socket.close();
+		if (i == 100) {
+			ok = false;
+			return 0;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	const std::string request =
+		"GET /hello HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"\r\n";
+	// the size of a response is found from the first one,
+	// the others are the same (`Date` has a fixed size)
+	std::size_t response_size = 0;
+	{
+		asio::write(socket, asio::buffer(request));
+		beast::flat_buffer buffer;
+		http::response<http::string_body> res;
+		response_size = http::read(socket, buffer, res);
+		if (res.result() != http::status::ok || !res.keep_alive()
+			|| res.body() != R"({"msg":"hello, world!"})" || buffer.size() != 0) {
+			ok = false;
+			return 0;
+		}
+	}
+	std::array<char, 4096> buffer;
+	if (response_size > buffer.size()) {
+		ok = false;
+		return 0;
+	}
+	std::size_t before = 0;
+	for (int i = 1; i < WARM_UP + N; ++i) {
+		if (i == WARM_UP) before = allocations.load();
+		beast::error_code ec;
+		asio::write(socket, asio::buffer(request), ec);
+		if (!ec) asio::read(socket, asio::buffer(buffer.data(), response_size), ec);
+		if (ec) {
+			ok = false;
+			return 0;
+		}
+	}
+	std::size_t session_allocations = allocations.load() - before;
+	// the server shuts down when the connection is closed
+	beast::error_code ec;
+	socket.shutdown(tcp::socket::shutdown_both, ec);
+	socket.close(ec);
+	return session_allocations;
+}
+// the writes are started from the completion handlers,
+// like the next response of a keep-alive connection.
+struct connection {
+	asio::io_context ioc;
+	beast::tcp_stream stream{ ioc };
+	tcp::socket client{ ioc };
+	bserv::handler_memory memory;
+	std::array<char, 4096> buffer;
+	bool ok = true;
+	connection() {
+		tcp::acceptor acceptor{ ioc, { asio::ip::make_address("127.0.0.1"), 0 } };
+		client.connect(acceptor.local_endpoint());
+		stream.socket() = acceptor.accept();
+	}
+	// reads a response of `size` bytes on the client
+	void read(std::size_t size) {
+		std::size_t n = 0;
+		while (n < size) n += client.read_some(asio::buffer(buffer.data() + n, size - n));
+	}
+};
+// `write(done)` writes a response and calls `done` after it is read,
+// returns the number of allocations made by the last `N` writes.
+template <typename Write>
+std::size_t count(connection& c, Write&& write) {
+	int i = 0;
+	std::size_t before = 0;
+	std::function<void()> next = [&] {
+		if (i == WARM_UP) before = allocations.load();
+		if (i++ == WARM_UP + N) return;
+		write(next);
+	};
+	asio::post(c.ioc, next);
+	c.ioc.restart();
+	c.ioc.run();
+	return allocations.load() - before;
+}
+int main()
+{
+	// the records of `lgtrace` are not allocated if logging is disabled
+	boost::log::core::get()->set_logging_enabled(false);
+	std::thread server_thread{ [] {
+		bserv::server_config config;
+		config.set_port(PORT);
+		config.set_num_threads(1);
+		bserv::server{
+			config,
+			{
+				bserv::make_path("/hello", &hello,
+					bserv::placeholders::response)
+			}
+		};
+	} };
+	bool session_ok = true;
+	std::size_t session_allocations = count_session(session_ok);
+	std::raise(SIGTERM);
+	server_thread.join();
+	std::cout << "http_session: " << session_allocations
+		<< " allocation(s) for " << N << " requests" << std::endl;
+
+	connection c;
+	bserv::prebuilt_response prebuilt{
+		http::status::not_found, "The requested url does not exist." };
+	std::array<char, bserv::HTTP_DATE_SIZE> date;
+	std::size_t prebuilt_size = 0;
+	for (auto& b : prebuilt.buffers(11, true, date.data())) prebuilt_size += b.size();
+	std::size_t prebuilt_allocations = count(c, [&](auto& done) {
+		auto d = bserv::http_date();
+		std::copy(d.begin(), d.end(), date.begin());
+		c.stream.expires_after(std::chrono::seconds(30));
+		asio::async_write(
+			c.stream, prebuilt.buffers(11, true, date.data()),
+			bserv::bind_handler_memory(c.memory,
+				[&](beast::error_code ec, std::size_t) {
+					if (ec) c.ok = false;
+					c.read(prebuilt_size);
+					done();
+				}));
+		});
+	std::cout << "prebuilt response: " << prebuilt_allocations
+		<< " allocation(s) for " << N << " responses" << std::endl;
+
+	const std::string raw_request =
+		"POST /echo HTTP/1.1\r\n"
+		"Host: localhost:8080\r\n"
+		"User-Agent: python-requests/2.25.1\r\n"
+		"Accept: */*\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: 13\r\n"
+		"\r\n"
+		"{\"id\": \"abc\"}";
+	boost::optional<http::request_parser<http::string_body, bserv::pool_allocator<char>>> parser;
+	std::string body;
+	auto parse = [&] {
+		parser.emplace();
+		parser->get().body() = std::move(body);
+		beast::error_code ec;
+		parser->eager(true);
+		parser->put(asio::buffer(raw_request), ec);
+		if (ec || !parser->is_done() || parser->get().body() != "{\"id\": \"abc\"}") c.ok = false;
+		body = std::move(parser->get().body());
+		body.clear();
+	};
+	for (int i = 0; i < WARM_UP; ++i) parse();
+	std::size_t before = allocations.load();
+	for (int i = 0; i < N; ++i) parse();
+	std::size_t parser_allocations = allocations.load() - before;
+	std::cout << "request parser: " << parser_allocations
+		<< " allocation(s) for " << N << " requests" << std::endl;
+
+	if (!session_ok || !c.ok || session_allocations != 0
+		|| prebuilt_allocations != 0 || parser_allocations != 0) {
+		std::cout << "test failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <string>
+#include <optional>
+#include <chrono>
+#include <cstdlib>
+#include <bserv/common.hpp>
+#include <boost/json.hpp>
+// checks `bind_params` and compares it against reading the same
+// fields from `json_params` (an object built for the whole body).
+const int N = 200000;  // number of requests
+struct signup {
+	std::string username;
+	std::string password;
+	int age;
+	std::optional<std::string> email;
+	std::optional<bool> subscribe;
+	boost::json::value profile;
+};
+BSERV_PARAMS_FIELDS(signup, username, password, age, email, subscribe, profile)
+bserv::request_type make_request(const std::string& target, const std::string& body) {
+	bserv::request_type request{ bserv::http::verb::post, target, 11 };
+	request.set(bserv::http::field::content_type, "application/json");
+	request.body() = body;
+	return request;
+}
+template <typename Func>
+void measure(const std::string& name, Func&& func) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < N; ++i) func();
+	auto end = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(end - start).count();
+	std::cout << name << ": " << elapsed / N * 1e9 << "ns/request" << std::endl;
+}
+int main()
+{
+	const std::string body = R"({"username":"bserv","password":"secret","age":7,)"
+		R"("profile":{"tags":["a","b"]},"ignored":[1,{"x":null}],"subscribe":true})";
+	auto request = make_request("/signup?email=a%40b.c&age=8", body);
+	auto result = bserv::bind_params<signup>(request);
+	if (!result.ok() || result.value.username != "bserv" || result.value.age != 7
+		|| result.value.email != "a@b.c" || result.value.subscribe != true
+		|| result.value.profile.as_object().at("tags").as_array().size() != 2) {
+		std::cout << "test failed: " << result.message() << std::endl;
+		return EXIT_FAILURE;
+	}
+	auto bad = bserv::bind_params<signup>(
+		make_request("/signup", R"({"username":1,"age":1.5,"profile":null})"));
+	if (bad.errors.size() != 3) {
+		std::cout << "test failed: " << bad.message() << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "errors: " << bad.message() << std::endl;
+	measure("json_params", [&] {
+		auto params = bserv::request_params{ request }.release();
+		signup s;
+		s.username = params["username"].as_string().c_str();
+		s.password = params["password"].as_string().c_str();
+		s.age = static_cast<int>(params["age"].as_int64());
+		if (params.count("email")) s.email = params["email"].as_string().c_str();
+		if (params.count("subscribe")) s.subscribe = params["subscribe"].as_bool();
+		s.profile = params["profile"];
+		});
+	measure("bind_params", [&] {
+		bserv::bind_params<signup>(request);
+		});
+	return EXIT_SUCCESS;
+}
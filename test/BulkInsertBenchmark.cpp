@@ -0,0 +1,75 @@
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <chrono>
+#include <bserv/common.hpp>
+#include <boost/json.hpp>
+// compares row-at-a-time `exec` against `bulk_insert` (COPY) for
+// inserting N rows into `auth_user` (see `db.sql`).
+// all the transactions are aborted, so the table is left untouched.
+const int N = 100000;
+const std::string PASSWORD = "salt$hashed_password";
+std::string get_username(const std::string& prefix, int i) {
+	return "bulk_" + prefix + "_" + std::to_string(i);
+}
+template <typename Func>
+double measure(const std::string& name, Func&& func) {
+	auto start = std::chrono::steady_clock::now();
+	func();
+	auto end = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(end - start).count();
+	std::cout << name << ": " << elapsed << "s ("
+		<< (int)(N / elapsed) << " rows/s)" << std::endl;
+	return elapsed;
+}
+int main()
+{
+	std::string config_content = bserv::utils::file::read_bin("../config.json");
+	boost::json::object config_obj = boost::json::parse(config_content).as_object();
+	bserv::db_connection_manager mgr{ config_obj["conn-str"].as_string().c_str(), 1 };
+	std::shared_ptr<bserv::db_connection> conn = mgr.get_or_block();
+	const std::vector<std::string> columns{
+		"username", "password", "is_superuser",
+		"first_name", "last_name", "email", "is_active" };
+	double exec_time = measure("exec", [&] {
+		bserv::db_transaction tx{ conn };
+		for (int i = 0; i < N; ++i) {
+			tx.exec(
+				"insert into auth_user "
+				"(username, password, is_superuser, "
+				"first_name, last_name, email, is_active) values "
+				"(?, ?, ?, ?, ?, ?, ?);",
+				get_username("exec", i), PASSWORD, false,
+				"first", "last", "user@bserv.com", true);
+		}
+		tx.abort();
+		});
+	double tuple_time = measure("bulk_insert (tuple)", [&] {
+		std::vector<std::tuple<std::string, std::string, bool,
+			std::string, std::string, std::string, bool>> rows;
+		rows.reserve(N);
+		for (int i = 0; i < N; ++i) {
+			rows.emplace_back(
+				get_username("tuple", i), PASSWORD, false,
+				"first", "last", "user@bserv.com", true);
+		}
+		bserv::db_transaction tx{ conn };
+		tx.bulk_insert("auth_user", columns, rows);
+		tx.abort();
+		});
+	double json_time = measure("bulk_insert (json)", [&] {
+		boost::json::array rows;
+		rows.reserve(N);
+		for (int i = 0; i < N; ++i) {
+			rows.push_back(boost::json::array{
+				get_username("json", i), PASSWORD, false,
+				"first", "last", "user@bserv.com", true });
+		}
+		bserv::db_transaction tx{ conn };
+		tx.bulk_insert("auth_user", columns, rows);
+		tx.abort();
+		});
+	std::cout << "speedup (tuple): " << exec_time / tuple_time << "x" << std::endl;
+	std::cout << "speedup (json): " << exec_time / json_time << "x" << std::endl;
+}
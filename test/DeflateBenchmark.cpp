@@ -0,0 +1,77 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <bserv/common.hpp>
+#include <boost/beast/zlib.hpp>
+#include <boost/json.hpp>
+// measures the cost of permessage-deflate on a synthetic json stream.
+// each message is compressed with the same stream and a sync flush,
+// as permessage-deflate does with context takeover.
+const int N = 20000;  // number of messages
+namespace zlib = boost::beast::zlib;
+std::vector<std::string> make_messages() {
+	std::vector<std::string> messages;
+	for (int i = 0; i < N; ++i) {
+		boost::json::array users;
+		for (int j = 0; j < 10; ++j) {
+			users.push_back({
+				{"id", i * 10 + j},
+				{"username", "user_" + std::to_string(i * 10 + j)},
+				{"first_name", "first"},
+				{"last_name", "last"},
+				{"email", "user_" + std::to_string(j) + "@bserv.com"},
+				{"is_active", j % 3 != 0},
+				{"is_superuser", false} });
+		}
+		messages.emplace_back(boost::json::serialize(boost::json::object{
+			{"topic", "users"}, {"seq", i}, {"users", users} }));
+	}
+	return messages;
+}
+void measure(const std::vector<std::string>& messages,
+	int window_bits, int mem_level, std::size_t threshold) {
+	zlib::deflate_stream ds;
+	ds.reset(zlib::default_size, window_bits, mem_level, zlib::Strategy::normal);
+	std::size_t in_bytes = 0, out_bytes = 0;
+	std::string out;
+	auto start = std::chrono::steady_clock::now();
+	for (const auto& message : messages) {
+		in_bytes += message.size();
+		if (message.size() < threshold) {
+			out_bytes += message.size();
+			continue;
+		}
+		out.resize(message.size() + 64);
+		zlib::z_params zs;
+		zs.next_in = message.data();
+		zs.avail_in = message.size();
+		zs.next_out = &out[0];
+		zs.avail_out = out.size();
+		boost::beast::error_code ec;
+		ds.write(zs, zlib::Flush::sync, ec);
+		// the trailing 0x00 0x00 0xff 0xff is removed from each message
+		out_bytes += zs.total_out - 4;
+	}
+	auto end = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(end - start).count();
+	std::cout << "window bits " << window_bits
+		<< ", mem level " << mem_level
+		<< ", threshold " << threshold << ": "
+		<< "ratio " << (double)in_bytes / out_bytes
+		<< ", saved " << (in_bytes - out_bytes) / 1024 << " KiB, "
+		<< "cpu " << elapsed * 1e6 / messages.size() << " us/message ("
+		<< in_bytes / elapsed / 1024 / 1024 << " MiB/s)" << std::endl;
+}
+int main()
+{
+	auto messages = make_messages();
+	std::size_t total = 0;
+	for (const auto& message : messages) total += message.size();
+	std::cout << N << " messages, " << total / N << " bytes on average" << std::endl;
+	measure(messages, bserv::WEBSOCKET_DEFLATE_WINDOW_BITS,
+		bserv::WEBSOCKET_DEFLATE_MEM_LEVEL, bserv::WEBSOCKET_DEFLATE_THRESHOLD);
+	for (int window_bits : {9, 12, 15})
+		for (int mem_level : {1, 4, 8})
+			measure(messages, window_bits, mem_level, 0);
+}
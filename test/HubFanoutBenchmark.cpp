@@ -0,0 +1,116 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <bserv/common.hpp>
+#include <boost/json.hpp>
+// fans out M messages to N local websocket clients through `websocket_hub`.
+// the server and the clients run in the same process, the limit of open
+// files should be raised first (e.g. `ulimit -n 65536`).
+const int N = 10000;  // number of clients
+const int M = 100;  // number of messages
+const unsigned short PORT = 8081;
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+using asio::ip::tcp;
+auto hub = std::make_shared<bserv::websocket_hub>(M);
+std::atomic<int> subscribed{ 0 };
+std::atomic<int> finished{ 0 };
+std::atomic<int> failed{ 0 };
+std::nullopt_t ws_hub(
+	std::shared_ptr<bserv::websocket_server> ws_server) {
+	auto subscription = hub->subscribe("bench", ws_server->session());
+	ws_server->write("subscribed");
+	while (true) {
+		try {
+			ws_server->read_view();
+		}
+		catch (bserv::websocket_closed&) {
+			break;
+		}
+	}
+	return std::nullopt;
+}
+void client(asio::io_context& ioc, asio::yield_context yield) {
+	beast::error_code ec;
+	websocket::stream<beast::tcp_stream> ws{ ioc };
+	beast::get_lowest_layer(ws).async_connect(
+		tcp::endpoint{ asio::ip::make_address("127.0.0.1"), PORT }, yield[ec]);
+	if (!ec) ws.async_handshake("localhost", "/hub", yield[ec]);
+	beast::flat_buffer buffer;
+	// "subscribed"
+	if (!ec) ws.async_read(buffer, yield[ec]);
+	if (ec) {
+		++failed;
+		return;
+	}
+	++subscribed;
+	for (int i = 0; i < M; ++i) {
+		buffer.clear();
+		ws.async_read(buffer, yield[ec]);
+		if (ec) {
+			++failed;
+			return;
+		}
+	}
+	++finished;
+	ws.async_close(websocket::close_code::normal, yield[ec]);
+}
+int main()
+{
+	std::thread server_thread{ [] {
+		bserv::server_config config;
+		config.set_port(PORT);
+		config.set_log_path("");
+		// all the clients are on the same ip
+		config.set_max_websocket_sessions(N);
+		config.set_max_websocket_sessions_per_ip(N);
+		bserv::server{
+			config,
+			{},
+			{
+				bserv::make_path("/hub", &ws_hub,
+					bserv::placeholders::websocket_server_ptr)
+			}
+		};
+	} };
+	server_thread.detach();
+	std::this_thread::sleep_for(std::chrono::seconds{ 1 });
+	asio::io_context ioc;
+	for (int i = 0; i < N; ++i)
+		asio::spawn(ioc, [&](asio::yield_context yield) { client(ioc, yield); });
+	std::vector<std::thread> client_threads;
+	for (int i = 0; i < 4; ++i)
+		client_threads.emplace_back([&] { ioc.run(); });
+	while (subscribed + failed < N)
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+	std::cout << "clients: " << subscribed << " (" << failed << " failed)" << std::endl;
+	boost::json::object message{
+		{"topic", "bench"},
+		{"payload", std::string(256, 'x')} };
+	auto start = std::chrono::steady_clock::now();
+	std::size_t queued = 0;
+	for (int i = 0; i < M; ++i) {
+		message["seq"] = i;
+		queued += hub->publish("bench", message);
+	}
+	auto published = std::chrono::steady_clock::now();
+	while (finished + failed < N)
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+	auto end = std::chrono::steady_clock::now();
+	double publish_time = std::chrono::duration<double>(published - start).count();
+	double elapsed = std::chrono::duration<double>(end - start).count();
+	auto stats = hub->stats();
+	std::cout << "publish: " << publish_time << "s ("
+		<< (int)(queued / publish_time) << " messages queued/s)" << std::endl;
+	std::cout << "delivery: " << elapsed << "s ("
+		<< (int)(finished * (double)M / elapsed) << " messages/s)" << std::endl;
+	std::cout << "dropped: " << stats.dropped
+		<< ", disconnected: " << stats.disconnected << std::endl;
+	for (auto& t : client_threads) t.join();
+	std::exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <bserv/common.hpp>
+#include <boost/json.hpp>
+// compares the MessagePack codec against json text on synthetic messages.
+// the buffers are reused across the messages, as in a websocket session.
+const int N = 20000;  // number of messages
+std::vector<boost::json::value> make_messages() {
+	std::vector<boost::json::value> messages;
+	for (int i = 0; i < N; ++i) {
+		boost::json::array points;
+		for (int j = 0; j < 16; ++j)
+			points.push_back({ i * 16 + j, (i + j) * 0.25, -j });
+		messages.emplace_back(boost::json::object{
+			{"topic", "ticks"},
+			{"seq", i},
+			{"ok", i % 2 == 0},
+			{"note", nullptr},
+			{"points", points} });
+	}
+	return messages;
+}
+template <typename Func>
+double measure(const std::string& name, std::size_t bytes, Func&& func) {
+	auto start = std::chrono::steady_clock::now();
+	func();
+	auto end = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(end - start).count();
+	std::cout << name << ": " << elapsed << "s ("
+		<< (int)(N / elapsed) << " messages/s, "
+		<< bytes / elapsed / 1024 / 1024 << " MiB/s)" << std::endl;
+	return elapsed;
+}
+int main()
+{
+	auto messages = make_messages();
+	std::vector<std::string> texts, packs;
+	std::size_t text_bytes = 0, pack_bytes = 0;
+	for (const auto& message : messages) {
+		texts.emplace_back(boost::json::serialize(message));
+		packs.emplace_back(bserv::msgpack::encode(message));
+		text_bytes += texts.back().size();
+		pack_bytes += packs.back().size();
+		if (bserv::msgpack::decode(packs.back()) != message) {
+			std::cout << "test failed: " << texts.back() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::cout << "json: " << text_bytes / N << " bytes/message, "
+		<< "msgpack: " << pack_bytes / N << " bytes/message" << std::endl;
+	std::string buffer;
+	measure("json serialize", text_bytes, [&] {
+		for (const auto& message : messages) {
+			buffer = boost::json::serialize(message);
+		}
+		});
+	measure("msgpack encode", pack_bytes, [&] {
+		for (const auto& message : messages) {
+			buffer.clear();
+			bserv::msgpack::encode(message, buffer);
+		}
+		});
+	boost::json::monotonic_resource mr;
+	boost::json::parser parser;
+	measure("json parse", text_bytes, [&] {
+		for (const auto& text : texts) {
+			mr.release();
+			parser.reset(&mr);
+			parser.write(text);
+			parser.release();
+		}
+		});
+	measure("msgpack decode", pack_bytes, [&] {
+		for (const auto& pack : packs) {
+			mr.release();
+			bserv::msgpack::decode(pack, &mr);
+		}
+		});
+}
@@ -0,0 +1,88 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <bserv/common.hpp>
+// checks the multipart parser against bodies split at every position,
+// and measures its throughput on a large file part.
+const std::string BOUNDARY = "----bservBoundary7MA4YWxkTrZu0gW";
+std::string make_body(const std::string& file) {
+	return "preamble\r\n"
+		"--" + BOUNDARY + "\r\n"
+		"Content-Disposition: form-data; name=\"title\"\r\n"
+		"\r\n"
+		"hello\r\n-- world\r\n"
+		"--" + BOUNDARY + "\r\n"
+		"Content-Disposition: form-data; name=\"upload\"; filename=\"a;b.txt\"\r\n"
+		"Content-Type: text/plain\r\n"
+		"\r\n"
+		+ file + "\r\n"
+		"--" + BOUNDARY + "--\r\n"
+		"epilogue";
+}
+struct result {
+	std::vector<bserv::multipart_part> parts;
+	std::vector<std::string> contents;
+};
+result parse(std::string_view body, std::size_t chunk_size) {
+	result r;
+	bserv::multipart_parser parser{ BOUNDARY };
+	parser.on_part_begin = [&r](const bserv::multipart_part& part) {
+		r.parts.push_back(part);
+		r.contents.emplace_back();
+	};
+	parser.on_data = [&r](std::string_view data) {
+		r.contents.back().append(data);
+	};
+	for (std::size_t i = 0; i < body.size(); i += chunk_size)
+		parser.write(body.substr(i, chunk_size));
+	parser.finish();
+	return r;
+}
+bool check(std::string_view body, const std::string& file, std::size_t chunk_size) {
+	auto r = parse(body, chunk_size);
+	return r.parts.size() == 2
+		&& r.parts[0].name == "title" && !r.parts[0].filename.has_value()
+		&& r.contents[0] == "hello\r\n-- world"
+		&& r.parts[1].name == "upload" && r.parts[1].filename == "a;b.txt"
+		&& r.parts[1].content_type == "text/plain"
+		&& r.contents[1] == file;
+}
+int main()
+{
+	// the content contains prefixes of the delimiter
+	std::string file = "line\r\n--" + BOUNDARY.substr(0, 10) + "\r\r\n-";
+	std::string body = make_body(file);
+	for (std::size_t chunk_size = 1; chunk_size <= body.size(); ++chunk_size) {
+		if (!check(body, file, chunk_size)) {
+			std::cout << "test failed: chunk size " << chunk_size << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (bserv::multipart_boundary("multipart/form-data; boundary=\"" + BOUNDARY + "\"") != BOUNDARY
+		|| bserv::multipart_boundary("application/json").has_value()) {
+		std::cout << "test failed: boundary" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "multipart parser: ok" << std::endl;
+
+	std::string large(64 * 1024 * 1024, 'x');
+	for (std::size_t i = 0; i < large.size(); i += 97) large[i] = '\r';
+	body = make_body(large);
+	for (std::size_t chunk_size : { 4 * 1024, 64 * 1024, 1024 * 1024 }) {
+		auto start = std::chrono::steady_clock::now();
+		std::size_t bytes = 0;
+		bserv::multipart_parser parser{ BOUNDARY };
+		parser.on_data = [&bytes](std::string_view data) { bytes += data.size(); };
+		for (std::size_t i = 0; i < body.size(); i += chunk_size)
+			parser.write(std::string_view{ body }.substr(i, chunk_size));
+		parser.finish();
+		auto end = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(end - start).count();
+		std::cout << "chunk size " << chunk_size << ": " << elapsed << "s ("
+			<< bytes / elapsed / 1024 / 1024 << " MiB/s)" << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <bserv/common.hpp>
+#include <boost/json.hpp>
+// compares building the whole object of a large json body (`json_params`)
+// against looking up a few keys lazily (`request_params`).
+const int N = 20;  // number of requests
+bserv::request_type make_request() {
+	boost::json::array items;
+	for (int i = 0; i < 50000; ++i)
+		items.push_back(boost::json::object{
+			{"id", i},
+			{"name", "item " + std::to_string(i)},
+			{"tags", boost::json::array{ "a", "b", "c" }} });
+	boost::json::object body{
+		{"id", 42},
+		{"items", items},
+		{"user", "bserv"} };
+	bserv::request_type request{ bserv::http::verb::post, "/echo", 11 };
+	request.set(bserv::http::field::content_type, "application/json");
+	request.body() = boost::json::serialize(body);
+	return request;
+}
+template <typename Func>
+void measure(const std::string& name, std::size_t bytes, Func&& func) {
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < N; ++i) func();
+	auto end = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(end - start).count();
+	std::cout << name << ": " << elapsed / N * 1000 << "ms/request ("
+		<< bytes * N / elapsed / 1024 / 1024 << " MiB/s)" << std::endl;
+}
+int main()
+{
+	auto request = make_request();
+	std::size_t bytes = request.body().size();
+	std::cout << "body: " << bytes / 1024 << " KiB" << std::endl;
+	{
+		bserv::request_params params{ request };
+		auto* id = params.find("id");
+		auto* user = params.find("user");
+		if (id == nullptr || *id != 42 || user == nullptr || *user != "bserv"
+			|| params.contains("missing")
+			|| params.object().size() != 3) {
+			std::cout << "test failed" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	{
+		// the last of the duplicate keys, the same as `json_params`
+		bserv::request_type duplicated{ bserv::http::verb::post, "/echo", 11 };
+		duplicated.set(bserv::http::field::content_type, "application/json");
+		duplicated.body() = R"({"a": 1, "b": {"a": 0}, "a": 2})";
+		bserv::request_params params{ duplicated };
+		auto* a = params.find("a");
+		auto* b = params.find("b");
+		if (a == nullptr || *a != 2 || b == nullptr
+			|| params.object().at("a") != 2) {
+			std::cout << "test failed: duplicate keys" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	measure("full object", bytes, [&] {
+		bserv::request_params params{ request };
+		params.release();
+		});
+	measure("one key", bytes, [&] {
+		bserv::request_params params{ request };
+		params.find("id");
+		});
+	measure("two keys", bytes, [&] {
+		bserv::request_params params{ request };
+		params.find("id");
+		params.find("user");
+		});
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <bserv/common.hpp>
+#include <boost/json.hpp>
+// each route reports the port of the postgresql server it is connected to.
+// `conn-str` should refer to the primary and `replica-conn-strs` to the
+// replicas (e.g. two local instances listening on 5432 and 5433).
+boost::json::object get_port(
+	std::shared_ptr<bserv::db_connection> conn) {
+	bserv::db_transaction tx{ conn };
+	bserv::db_result r = tx.exec("select current_setting('port');");
+	return {
+		{"port", (*r.begin())[0].as<std::string>()}
+	};
+}
+boost::json::object primary(
+	std::shared_ptr<bserv::db_connection> conn) {
+	return get_port(conn);
+}
+boost::json::object replica(
+	std::shared_ptr<bserv::db_connection> conn) {
+	return get_port(conn);
+}
+int main()
+{
+	std::string config_content = bserv::utils::file::read_bin("../config.json");
+	boost::json::object config_obj = boost::json::parse(config_content).as_object();
+	bserv::server_config config;
+	config.set_db_conn_str(config_obj["conn-str"].as_string().c_str());
+	std::vector<std::string> replica_conn_strs;
+	for (auto& conn_str : config_obj["replica-conn-strs"].as_array())
+		replica_conn_strs.emplace_back(conn_str.as_string().c_str());
+	config.set_db_replica_conn_strs(std::move(replica_conn_strs));
+	bserv::server{
+		config,
+		{
+			bserv::make_path("/primary", &primary,
+				bserv::placeholders::db_connection_ptr),
+			bserv::make_path("/replica", &replica,
+				bserv::placeholders::db_read_connection_ptr)
+		}
+	};
+}
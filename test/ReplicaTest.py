@@ -0,0 +1,28 @@
+import sys
+import requests
+from collections import Counter
+
+# usage: python ReplicaTest.py [primary port]
+# - with all the replicas running, `/replica` should never reach the primary.
+# - stop one of the replicas (e.g. `pg_ctl stop -D [data dir]`) and run it
+#   again: the failed replica drops out and its share moves to the others,
+#   or to the primary if none is left.
+# - start it again: after the reconnect backoff, it is used again.
+
+N = 200  # number of requests
+
+if __name__ == '__main__':
+    primary_port = requests.get("http://localhost:8080/primary").json()["port"]
+    if len(sys.argv) == 2 and sys.argv[1] != primary_port:
+        print('test failed: unexpected primary', primary_port)
+    ports = Counter()
+    for _ in range(N):
+        res = requests.get("http://localhost:8080/replica")
+        if res.status_code != 200:
+            print('test failed:', res.status_code, res.text)
+            continue
+        ports[res.json()["port"]] += 1
+    print('primary:', primary_port)
+    print('reads:', dict(ports))
+    if primary_port in ports:
+        print('reads reached the primary (no replica available?)')
@@ -0,0 +1,34 @@
+import requests
+
+# `requests` decompresses the body, so the bodies can be compared directly
+
+URLS = [
+    "http://localhost:8080/statics/css/bootstrap.min.css",
+    "http://localhost:8080/statics/js/bootstrap.bundle.min.js",
+    "http://localhost:8080/",
+]
+
+
+def test(url):
+    plain = requests.get(url, headers={"Accept-Encoding": "identity"})
+    if 'Content-Encoding' in plain.headers:
+        print('test failed: compressed without being accepted', url)
+    for encoding in ["gzip", "deflate"]:
+        resp = requests.get(url, headers={"Accept-Encoding": encoding})
+        if resp.headers.get('Content-Encoding') != encoding:
+            # a small page is not compressed, and static files are gzip only
+            print('not compressed with', encoding + ':', url)
+            continue
+        if resp.content != plain.content:
+            print('test failed: different content', url, encoding)
+        print(url, encoding, resp.headers['Content-Length'], '/', len(plain.content))
+    # an explicit zero overrides the wildcard
+    resp = requests.get(url, headers={"Accept-Encoding": "gzip;q=0, *"})
+    if resp.headers.get('Content-Encoding') == 'gzip':
+        print('test failed: gzip;q=0 is not respected', url)
+
+
+if __name__ == '__main__':
+    for url in URLS:
+        test(url)
+    print('end of test')
@@ -0,0 +1,50 @@
+import asyncio
+
+import requests
+import websockets
+
+import uuid
+from time import time
+
+# the number of subscribers, they share one database connection
+P = 1000
+
+# the WebApp should be running, with the database
+
+
+async def subscriber(uri, username, ready):
+    async with websockets.connect(uri) as websocket:
+        ready.release()
+        # the notifications of the other tests may arrive first
+        while True:
+            if await websocket.recv() == username:
+                return
+
+
+async def main():
+    username = str(uuid.uuid4())
+    ready = asyncio.Semaphore(0)
+    tasks = [
+        asyncio.ensure_future(subscriber(
+            "ws://localhost:8080/users/notifications", username, ready))
+        for _ in range(P)]
+    for _ in range(P):
+        await ready.acquire()
+    # the LISTEN is issued on the worker thread of the listener
+    await asyncio.sleep(1)
+    start = time()
+    ret = requests.post("http://localhost:8080/register", json={
+        "username": username,
+        "password": username}).json()
+    if not ret["success"]:
+        print('register failed:', ret)
+    try:
+        await asyncio.wait_for(asyncio.gather(*tasks), timeout=10)
+        print('test ended')
+    except asyncio.TimeoutError:
+        print('test failed: not all the subscribers were notified')
+    print('elapsed: ', time() - start)
+
+
+if __name__ == '__main__':
+    asyncio.get_event_loop().run_until_complete(main())
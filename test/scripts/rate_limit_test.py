@@ -0,0 +1,32 @@
+import requests
+
+# should match the rate limit of `/login` in the WebApp
+BURST = 200
+# the requests beyond the burst, most of which should be rejected
+EXTRA = 50
+
+
+def main():
+    session = requests.session()
+    data = {"username": "no-such-user", "password": "password"}
+    rejected = 0
+    for _ in range(BURST + EXTRA):
+        resp = session.post("http://localhost:8080/login", json=data)
+        if resp.status_code == 429:
+            if resp.headers.get('Retry-After') is None:
+                print('no Retry-After')
+            rejected += 1
+        elif resp.status_code != 200:
+            print('unexpected status:', resp.status_code)
+    print('rejected:', rejected)
+    # the bucket is refilled while the requests are sent
+    if rejected == 0 or rejected > EXTRA:
+        print('test failed')
+    # the other routes are not limited
+    if session.get("http://localhost:8080/hello").status_code != 200:
+        print('test failed')
+    print('test ended')
+
+
+if __name__ == '__main__':
+    main()
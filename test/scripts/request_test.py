@@ -19,6 +19,21 @@ def size_test():
         print("size test: ok")
     print()
 
+def error_test():
+    session = requests.session()
+    # the prebuilt 404 keeps the connection alive
+    for _ in range(3):
+        resp = session.get("http://localhost:8080/no/such/url")
+        if resp.status_code != 404 or 'Date' not in resp.headers \
+                or resp.headers.get('Server') != 'bserv':
+            print("error test: failed", resp.status_code, resp.headers)
+            return
+    if session.get("http://localhost:8080/hello").status_code != 200:
+        print("error test: failed after 404")
+        return
+    print("error test: ok")
+    print()
+
 P = 100  # number of concurrent processes
 N = 5  # for each process, the number of sessions
 R = 10  # for each session, the number of posts
@@ -38,6 +53,7 @@ def test(i):
 
 if __name__ == '__main__':
     size_test()
+    error_test()
     # exit()
 
     processes = [Process(target=test, args=(i, )) for i in range(P)]
@@ -0,0 +1,109 @@
+import asyncio
+import os
+import signal
+import sys
+import threading
+import time
+
+import requests
+import websockets
+
+# usage: python shutdown_test.py <pid of the WebApp>
+# the WebApp is sent SIGTERM while requests are being made,
+# every request sent should be answered (or refused once the
+# listener is closed), and it should exit within the shutdown timeout.
+
+URL = "http://localhost:8080"
+THREADS = 20
+# the requests are made for this long before the signal
+DURATION = 1
+MiB = 1024 * 1024
+
+lock = threading.Lock()
+answered = 0
+refused = 0
+dropped = []
+stopping = threading.Event()
+
+
+def is_refused(e):
+    return 'refused' in str(e) or 'NewConnectionError' in str(e)
+
+
+def echo_worker():
+    global answered, refused
+    session = requests.session()
+    while True:
+        try:
+            resp = session.post(URL + "/echo", json={"id": "abc"})
+            if resp.status_code != 200 or resp.json() != {"echo": {"id": "abc"}}:
+                with lock:
+                    dropped.append(resp.status_code)
+            else:
+                with lock:
+                    answered += 1
+        except requests.exceptions.ConnectionError as e:
+            with lock:
+                if is_refused(e):
+                    refused += 1
+                else:
+                    dropped.append(str(e))
+            return
+
+
+def slow_upload():
+    # the body is still being sent when the signal arrives
+    def chunks():
+        for _ in range(4):
+            yield b'x' * MiB
+            time.sleep(0.5)
+    resp = requests.post(URL + "/upload", data=chunks())
+    if resp.status_code != 200 or resp.json()['size'] != 4 * MiB:
+        with lock:
+            dropped.append('upload: ' + str(resp.status_code))
+
+
+async def websocket_client():
+    async with websockets.connect("ws://localhost:8080/echo") as websocket:
+        await websocket.recv()
+        while not stopping.is_set():
+            await asyncio.sleep(0.1)
+        try:
+            while True:
+                await websocket.recv()
+        except websockets.exceptions.ConnectionClosed as e:
+            if e.code != 1001:
+                print('test failed: websocket close code', e.code)
+
+
+def main(pid):
+    ws = threading.Thread(
+        target=lambda: asyncio.new_event_loop().run_until_complete(websocket_client()))
+    ws.start()
+    workers = [threading.Thread(target=echo_worker) for _ in range(THREADS)]
+    workers.append(threading.Thread(target=slow_upload))
+    for w in workers:
+        w.start()
+    time.sleep(DURATION)
+    os.kill(pid, signal.SIGTERM)
+    stopping.set()
+    start = time.time()
+    for w in workers:
+        w.join()
+    ws.join()
+    # the server exits once all the connections are closed
+    while True:
+        try:
+            os.kill(pid, 0)
+        except OSError:
+            break
+        time.sleep(0.1)
+    print('answered:', answered, 'refused:', refused, 'dropped:', len(dropped))
+    print('exited in', time.time() - start, 'second(s)')
+    if dropped:
+        print('test failed:', dropped[:10])
+    print('test ended')
+
+
+if __name__ == '__main__':
+    main(int(sys.argv[1]))
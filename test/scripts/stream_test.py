@@ -0,0 +1,42 @@
+import json
+import http.client
+import requests
+
+# `/users/export` streams the users page by page with chunked encoding
+
+
+def test():
+    resp = requests.get("http://localhost:8080/users/export", stream=True)
+    if resp.headers.get('Transfer-Encoding') != 'chunked':
+        print('test failed: not chunked', resp.headers)
+    chunks = 0
+    users = 0
+    for chunk in resp.iter_content(chunk_size=None):
+        chunks += 1
+        for line in chunk.decode().splitlines():
+            user = json.loads(line)
+            if 'password' in user:
+                print('test failed: password exported', user)
+            users += 1
+    print('received', users, 'user(s) in', chunks, 'chunk(s)')
+
+
+def test_head():
+    # the response to HEAD has no body, so the next response
+    # on the same connection is read correctly
+    conn = http.client.HTTPConnection("localhost", 8080)
+    conn.request("HEAD", "/users/export")
+    resp = conn.getresponse()
+    if resp.status != 200 or resp.read() != b'':
+        print('test failed: HEAD', resp.status)
+    conn.request("GET", "/hello")
+    resp = conn.getresponse()
+    if resp.status != 200 or b'hello' not in resp.read():
+        print('test failed: the response after HEAD')
+    conn.close()
+
+
+if __name__ == '__main__':
+    test()
+    test_head()
+    print('end of test')
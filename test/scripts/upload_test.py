@@ -0,0 +1,55 @@
+import requests
+
+# `/upload` is a streaming route with a 64 MiB body limit
+
+URL = "http://localhost:8080/upload"
+MiB = 1024 * 1024
+
+
+def chunks(total, size=MiB):
+    for _ in range(total // size):
+        yield b'x' * size
+
+
+def test_upload(size):
+    resp = requests.post(URL, data=b'x' * size)
+    if resp.status_code != 200 or resp.json()['size'] != size:
+        print('test failed: upload', size, resp.status_code, resp.text)
+
+
+def test_chunked_upload(size):
+    # without Content-Length, the limit is checked while reading
+    resp = requests.post(URL, data=chunks(size))
+    if size > 64 * MiB:
+        if resp.status_code != 413:
+            print('test failed: chunked upload over the limit', resp.status_code)
+    elif resp.status_code != 200 or resp.json()['size'] != size:
+        print('test failed: chunked upload', size, resp.status_code, resp.text)
+
+
+def test_too_large():
+    # rejected from the header, before the body is sent
+    resp = requests.post(URL, data=b'x' * (65 * MiB),
+                         headers={'Expect': '100-continue'})
+    if resp.status_code != 413:
+        print('test failed: too large', resp.status_code)
+
+
+def test_form():
+    resp = requests.post("http://localhost:8080/upload_form",
+                         data={'title': 'hello'},
+                         files={'file': ('a.txt', b'x' * (3 * MiB), 'text/plain')})
+    form = resp.json()['echo']
+    if form.get('title') != 'hello' or form['file']['filename'] != 'a.txt' \
+            or form['file']['size'] != 3 * MiB:
+        print('test failed: form', form)
+
+
+if __name__ == '__main__':
+    test_upload(0)
+    test_upload(1000)
+    test_upload(20 * MiB)
+    test_chunked_upload(20 * MiB)
+    test_too_large()
+    test_form()
+    print('end of test')
@@ -0,0 +1,34 @@
+import asyncio
+
+import websockets
+
+# should match `ws-max-sessions-per-ip` of the WebApp
+MAX_PER_IP = 100
+# extra connections, which should be rejected
+EXTRA = 10
+
+
+async def main():
+    sockets = []
+    rejected = 0
+    for _ in range(MAX_PER_IP + EXTRA):
+        try:
+            sockets.append(await websockets.connect("ws://localhost:8080/echo"))
+        except websockets.exceptions.InvalidStatusCode as e:
+            if e.status_code != 503:
+                print('unexpected status:', e.status_code)
+            rejected += 1
+    print('accepted:', len(sockets), 'rejected:', rejected)
+    if len(sockets) != MAX_PER_IP or rejected != EXTRA:
+        print('test failed')
+    for websocket in sockets:
+        await websocket.close()
+    # the slots are released when the sessions are closed
+    await asyncio.sleep(1)
+    websocket = await websockets.connect("ws://localhost:8080/echo")
+    await websocket.close()
+    print('test ended')
+
+
+if __name__ == '__main__':
+    asyncio.get_event_loop().run_until_complete(main())